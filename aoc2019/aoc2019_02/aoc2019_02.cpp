@@ -5,6 +5,8 @@
 #include <vector>
 #include <assert.h>
 
+#include "intcode_parallel.h"
+
 int execute_program(std::vector<int> numbers)
 {
    assert(numbers.size() >= 5);
@@ -50,19 +52,23 @@ int main()
    auto result = execute_program(input);
    std::cout << result << '\n';
 
-   for (int noun = 0; noun <= 99; ++noun)
-   {
-      for (int verb = 0; verb <= 99; ++verb)
-      {
-         input[1] = noun;
-         input[2] = verb;
+   // the 100x100 noun/verb pairs are independent runs, spread over the
+   // threads of the pool and reported in the order of the serial sweep
+   thread_pool_t pool;
+   std::vector<int> firsts(100 * 100);
+
+   pool.for_each(firsts.size(), [&input, &firsts](size_t const index, size_t) {
+      auto numbers = input;
+      numbers[1] = static_cast<int>(index / 100);
+      numbers[2] = static_cast<int>(index % 100);
 
-         int first = execute_program(input);
+      firsts[index] = execute_program(std::move(numbers)); });
 
-         if (first == 19690720)
-         {
-            std::cout << 100 * noun + verb << '\n';
-         }
+   for (size_t index = 0; index < firsts.size(); ++index)
+   {
+      if (firsts[index] == 19690720)
+      {
+         std::cout << index << '\n';
       }
    }
-}
\ No newline at end of file
+}
@@ -0,0 +1,387 @@
+// intaot.cpp : This file contains the 'main' function. Program execution begins and ends there.
+//
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <set>
+#include <limits>
+
+#define FMT_HEADER_ONLY 1
+#include "fmt/core.h"
+#include "fmt/format.h"
+
+#include "intcode.h"
+
+// constant addresses above this are accessed through the growing load/store
+constexpr memory_unit MAX_PRESIZE = 1 << 20;
+
+std::string load_text(std::string const& path)
+{
+   std::ifstream input(path);
+   if (!input.is_open()) throw std::runtime_error("cannot open " + path);
+
+   std::string text;
+
+   input.seekg(0, std::ios::end);
+   text.reserve(input.tellg());
+   input.seekg(0, std::ios::beg);
+
+   text.assign(
+      std::istreambuf_iterator<char>(input),
+      std::istreambuf_iterator<char>());
+
+   return text;
+}
+
+std::string literal(memory_unit const value)
+{
+   if (value == std::numeric_limits<memory_unit>::min())
+      return "(-9223372036854775807LL - 1)";
+
+   // suffixed so that products of two literals are not computed as int
+   return value < 0 ? fmt::format("({0}LL)", value) : fmt::format("{0}LL", value);
+}
+
+bool is_write(int const opcode, int const param)
+{
+   switch (opcode)
+   {
+   case OP_ADD:
+   case OP_MUL:
+   case OP_LS:
+   case OP_EQ:       return param == 3;
+   case OP_IN:       return param == 1;
+   default:          return false;
+   }
+}
+
+class translator_t
+{
+   memory_t const&              memory;
+   decoded_stream_t             sweep;
+   std::map<offset_t, decoded_t> code;
+   std::set<offset_t>           written;
+   std::vector<uint8_t>         guarded;
+   size_t                       size = 0;
+
+   int dynamic_jumps = 0;
+   int checked_writes = 0;
+   int guarded_writes = 0;
+
+public:
+   translator_t(memory_t const& mem) : memory(mem), sweep(decode_program(mem)), guarded(mem.size(), 0), size(mem.size())
+   {
+      explore();
+      analyze();
+   }
+
+   void write_header(std::ostream& out, std::string_view name, std::string_view source) const
+   {
+      out << "#pragma once\n\n";
+      out << "#include \"intcode_aot.h\"\n\n";
+      out << fmt::format("// {0} translated by intaot; do not edit\n", source);
+      out << fmt::format("class {0} : public aot_program_t\n{{\npublic:\n", name);
+      out << fmt::format("   {0}();\n\n", name);
+      out << "   void execute(program_t::input_t const& fin, program_t::output_t const& fout);\n";
+      out << "};\n";
+   }
+
+   void write_source(std::ostream& out, std::string_view name, std::string_view header)
+   {
+      out << "#include <iterator>\n\n";
+      out << fmt::format("#include \"{0}\"\n\n", header);
+
+      out << "static memory_unit const image[] =\n{";
+      for (size_t i = 0; i < memory.size(); ++i)
+         out << (i % 16 == 0 ? "\n   " : " ") << literal(memory[i]) << ",";
+      out << "\n};\n\n";
+
+      out << "static uint8_t const guarded_cells[] =\n{";
+      for (size_t i = 0; i < guarded.size(); ++i)
+         out << (i % 32 == 0 ? "\n   " : "") << int(guarded[i]) << ",";
+      out << "\n};\n\n";
+
+      out << fmt::format("{0}::{0}() :\n   aot_program_t(memory_t(std::begin(image), std::end(image)), {1}, guarded_cells, std::size(guarded_cells))\n{{\n}}\n\n", name, size);
+
+      out << fmt::format("void {0}::execute(program_t::input_t const& fin, program_t::output_t const& fout)\n{{\n", name);
+      out << "   if (halted) return;\n";
+      out << "   if (fallback) { interpret(fin, fout); return; }\n\n";
+      out << "   offset_t rb = rel_base;\n";
+      out << "   memory_unit value = 0;\n";
+      out << "   goto dispatch;\n\n";
+
+      out << "dispatch:\n   switch (ip)\n   {\n";
+      for (auto const& [ip, op] : code)
+         out << fmt::format("   case {0}: goto L{0};\n", ip);
+      out << "   default: goto fallback;\n   }\n\n";
+
+      for (auto const& [ip, op] : code)
+         write_instruction(out, ip, op);
+
+      out << "fallback:\n";
+      out << "   rel_base = rb;\n";
+      out << "   interpret(fin, fout);\n";
+      out << "}\n";
+   }
+
+   void report() const
+   {
+      std::cout << "instructions:   " << code.size() << '\n';
+      std::cout << "dynamic jumps:  " << dynamic_jumps << '\n';
+      std::cout << "checked writes: " << checked_writes << '\n';
+      std::cout << "guarded writes: " << guarded_writes << '\n';
+   }
+
+private:
+   bool is_folded(offset_t const cell) const { return written.count(cell) == 0; }
+
+   // instructions reachable from 0 through fallthrough and constant jumps;
+   // immediates that point at an instruction of the linear sweep are taken
+   // as code pointers too (return addresses pushed before a call)
+   void explore()
+   {
+      std::vector<offset_t> work{ 0 };
+
+      while (!work.empty())
+      {
+         offset_t ip = work.back();
+         work.pop_back();
+
+         if (ip < 0 || static_cast<size_t>(ip) >= memory.size() || code.count(ip) != 0)
+            continue;
+
+         decoded_t op = decode_instruction(memory[ip], ip);
+         if (op.opcode == 0 || op.next > memory.size())
+            continue;
+
+         code[ip] = op;
+
+         if (op.opcode != OP_HALT)
+            work.push_back(op.next);
+
+         if ((op.opcode == OP_JMPNZ || op.opcode == OP_JMPZ) && op.mod2 == MOD_IMMEDIATE)
+            work.push_back(memory[ip + 2]);
+
+         int const modes[] = { op.mod1, op.mod2, op.mod3 };
+         for (int k = 1; k < instruction_length(op.opcode); ++k)
+         {
+            memory_unit const value = memory[ip + k];
+            if (modes[k - 1] == MOD_IMMEDIATE &&
+               value >= 0 && static_cast<size_t>(value) < sweep.size() && sweep[value].opcode != 0)
+               work.push_back(value);
+         }
+      }
+   }
+
+   // operands that some instruction writes to are read from memory at run
+   // time; every other cell of the translated code is guarded
+   void analyze()
+   {
+      for (auto const& [ip, op] : code)
+      {
+         int const modes[] = { op.mod1, op.mod2, op.mod3 };
+         for (int k = 1; k < instruction_length(op.opcode); ++k)
+         {
+            if (is_write(op.opcode, k) && modes[k - 1] == MOD_POSITION)
+               written.insert(memory[ip + k]);
+
+            if (modes[k - 1] == MOD_POSITION && memory[ip + k] >= 0 && memory[ip + k] < MAX_PRESIZE)
+               size = std::max(size, static_cast<size_t>(memory[ip + k]) + 1);
+         }
+      }
+
+      for (auto const& [ip, op] : code)
+      {
+         guarded[ip] = 1;
+         for (int k = 1; k < instruction_length(op.opcode); ++k)
+         {
+            if (is_folded(ip + k))
+               guarded[ip + k] = 1;
+         }
+      }
+   }
+
+   std::string operand(offset_t const cell) const
+   {
+      return is_folded(cell) ? literal(memory[cell]) : fmt::format("memory[{0}]", cell);
+   }
+
+   bool is_static(offset_t const cell) const
+   {
+      return is_folded(cell) && memory[cell] >= 0 && static_cast<size_t>(memory[cell]) < size;
+   }
+
+   std::string read_param(offset_t const cell, int const mode) const
+   {
+      switch (mode)
+      {
+      case MOD_POSITION:
+         if (is_static(cell))
+            return fmt::format("memory[{0}]", memory[cell]);
+         return fmt::format("load({0})", operand(cell));
+      case MOD_IMMEDIATE:
+         return operand(cell);
+      case MOD_RELBASE:
+         return fmt::format("load(rb + {0})", operand(cell));
+      default:
+         return {};
+      }
+   }
+
+   std::string goto_next(offset_t const next) const
+   {
+      if (code.count(next) != 0)
+         return fmt::format("goto L{0};", next);
+
+      return fmt::format("ip = {0}; goto fallback;", next);
+   }
+
+   std::string write_param(offset_t const cell, int const mode, offset_t const next)
+   {
+      std::string bail = fmt::format("{{ ip = {0}; goto fallback; }}", next);
+
+      switch (mode)
+      {
+      case MOD_POSITION:
+         if (is_static(cell))
+         {
+            memory_unit const target = memory[cell];
+            if (static_cast<size_t>(target) < guarded.size() && guarded[target] != 0)
+            {
+               guarded_writes++;
+               return fmt::format("memory[{0}] = value; {1}", target, bail);
+            }
+            return fmt::format("memory[{0}] = value;", target);
+         }
+         checked_writes++;
+         return fmt::format("if (store({0}, value)) {1}", operand(cell), bail);
+      case MOD_RELBASE:
+         checked_writes++;
+         return fmt::format("if (store(rb + {0}, value)) {1}", operand(cell), bail);
+      default:
+         return {};
+      }
+   }
+
+   // a jump whose target is not a translated instruction known at
+   // translation time goes through the dispatch switch
+   std::string jump(offset_t const cell, int const mode)
+   {
+      if (mode == MOD_IMMEDIATE && is_folded(cell))
+         return goto_next(memory[cell]);
+
+      dynamic_jumps++;
+      return fmt::format("ip = {0}; goto dispatch;", read_param(cell, mode));
+   }
+
+   void write_instruction(std::ostream& out, offset_t const ip, decoded_t const& op)
+   {
+      std::string cells;
+      for (int k = 0; k < instruction_length(op.opcode); ++k)
+         cells += fmt::format(k == 0 ? "{0}" : ",{0}", memory[ip + k]);
+
+      out << fmt::format("L{0}: // {1}\n", ip, cells);
+
+      std::string const next = goto_next(op.next);
+      std::string const unsupported = fmt::format("   ip = {0}; goto fallback;\n", ip);
+
+      // invalid modes are left to the interpreter, which reports them
+      if (op.mod1 > MOD_RELBASE || op.mod2 > MOD_RELBASE || op.mod3 > MOD_RELBASE ||
+         (is_write(op.opcode, 1) && op.mod1 == MOD_IMMEDIATE) ||
+         (is_write(op.opcode, 3) && op.mod3 == MOD_IMMEDIATE))
+      {
+         out << unsupported;
+         return;
+      }
+
+      switch (op.opcode)
+      {
+      case OP_ADD:
+      case OP_MUL:
+      case OP_LS:
+      case OP_EQ:
+      {
+         char const* format =
+            op.opcode == OP_ADD ? "   value = {0} + {1};\n" :
+            op.opcode == OP_MUL ? "   value = {0} * {1};\n" :
+            op.opcode == OP_LS ? "   value = {0} < {1} ? 1 : 0;\n" :
+            "   value = {0} == {1} ? 1 : 0;\n";
+         out << fmt::format(format, read_param(ip + 1, op.mod1), read_param(ip + 2, op.mod2));
+         out << "   " << write_param(ip + 3, op.mod3, op.next) << '\n';
+         out << "   " << next << '\n';
+         break;
+      }
+      case OP_IN:
+         out << "   value = fin();\n";
+         out << "   " << write_param(ip + 1, op.mod1, op.next) << '\n';
+         out << "   " << next << '\n';
+         break;
+      case OP_OUT:
+         out << fmt::format("   value = {0};\n", read_param(ip + 1, op.mod1));
+         out << fmt::format("   ip = {0};\n", op.next);
+         out << "   if (fout(value)) { rel_base = rb; return; }\n";
+         out << "   " << next << '\n';
+         break;
+      case OP_JMPNZ:
+      case OP_JMPZ:
+         out << fmt::format("   if ({0} {1} 0) {{ {2} }}\n",
+            read_param(ip + 1, op.mod1), op.opcode == OP_JMPNZ ? "!=" : "==", jump(ip + 2, op.mod2));
+         out << "   " << next << '\n';
+         break;
+      case OP_BASEOFF:
+         out << fmt::format("   rb += {0};\n", read_param(ip + 1, op.mod1));
+         out << "   " << next << '\n';
+         break;
+      case OP_HALT:
+         out << fmt::format("   ip = {0}; rel_base = rb; halted = true;\n", ip);
+         out << "   return;\n";
+         break;
+      }
+   }
+};
+
+std::string file_name(std::string const& path)
+{
+   auto pos = path.find_last_of("\\/");
+   return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc != 4)
+   {
+      std::cout << "usage: intaot <program> <output stem> <class name>\n";
+      std::cout << "writes <output stem>.h and <output stem>.cpp\n";
+      return -1;
+   }
+
+   std::string const source = argv[1];
+   std::string const stem = argv[2];
+   std::string const name = argv[3];
+
+   try
+   {
+      auto memory = read_program(load_text(source));
+
+      translator_t translator(memory);
+
+      std::ofstream header(stem + ".h");
+      std::ofstream body(stem + ".cpp");
+      if (!header.is_open() || !body.is_open())
+         throw std::runtime_error("cannot write " + stem);
+
+      translator.write_header(header, name, file_name(source));
+      translator.write_source(body, name, file_name(stem) + ".h");
+
+      translator.report();
+   }
+   catch (std::exception const& ex)
+   {
+      std::cout << ex.what() << '\n';
+      return -1;
+   }
+}
@@ -0,0 +1,1266 @@
+// intbench.cpp : This file contains the 'main' function. Program execution begins and ends there.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <string_view>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <assert.h>
+
+#include "intcode.h"
+#include "intcode_jit.h"
+#include "intcode_asm.h"
+#include "intcode_replay.h"
+#include "intcode_batch.h"
+#include "intcode_parallel.h"
+#include "intcode_coroutine.h"
+#include "intcode_checkpoint.h"
+#include "intbench_memo.h"
+#include "aot_boost.h"
+#include "aot_beam.h"
+
+memory_t load_program(std::string const& path)
+{
+   std::ifstream input(path);
+   if (!input.is_open()) throw std::runtime_error("cannot open " + path);
+
+   std::string text;
+
+   input.seekg(0, std::ios::end);
+   text.reserve(input.tellg());
+   input.seekg(0, std::ios::beg);
+
+   text.assign(
+      std::istreambuf_iterator<char>(input),
+      std::istreambuf_iterator<char>());
+
+   return read_program(text);
+}
+
+// runs f repeatedly, checking every result against the expected one;
+// returns the time of one run
+template <typename T, typename F>
+double measure(std::string_view name, int const repeat, T const expected, F&& f)
+{
+   auto start = std::chrono::high_resolution_clock::now();
+
+   for (int i = 0; i < repeat; ++i)
+   {
+      if (f() != expected)
+         throw std::runtime_error("unexpected result: " + std::string(name));
+   }
+
+   auto end = std::chrono::high_resolution_clock::now();
+   auto ms = std::chrono::duration<double, std::milli>(end - start).count() / repeat;
+
+   std::cout << std::left << std::setw(40) << name << std::right << std::setw(12) << std::fixed << std::setprecision(3) << ms << " ms\n";
+   return ms;
+}
+
+// day 09 part 2: the BOOST program in sensor boost mode
+template <typename Program, typename Execute>
+memory_unit run_boost(Program program, Execute execute)
+{
+   memory_unit result = 0;
+   execute(program,
+      []() {return 2; },
+      [&result](memory_unit const value) {result = value; return false; });
+   return result;
+}
+
+// day 19 part 1: probe every point of a 50x50 grid with the beam program
+template <typename Program, typename Execute>
+int run_beam(Program const& prototype, Execute execute)
+{
+   int points = 0;
+
+   for (int y = 0; y < 50; ++y)
+   {
+      for (int x = 0; x < 50; ++x)
+      {
+         int ix = 0;
+         Program program{ prototype };
+         execute(program,
+            [x, y, &ix]() {return ix++ == 0 ? x : y; },
+            [&points](memory_unit const value) {points += value == 1; return false; });
+      }
+   }
+
+   return points;
+}
+
+// the parser read_program had before: find and atoll per value
+memory_t read_program_atoll(std::string_view text)
+{
+   memory_t memory;
+
+   size_t start = 0;
+   size_t end = text.find(',');
+   while (end != std::string_view::npos)
+   {
+      memory.push_back(std::atoll(text.data() + start));
+      start = end + 1;
+      end = text.find(',', start);
+   }
+   memory.push_back(std::atoll(text.data() + start));
+
+   return memory;
+}
+
+// a program text of the given number of values: mostly opcodes and small
+// operands, with large and negative numbers mixed in, as in real inputs
+std::string generate_program_text(size_t const count)
+{
+   std::mt19937_64 random{ 2019 };
+   std::uniform_int_distribution<int> kind(0, 9);
+   std::uniform_int_distribution<memory_unit> small(0, 2000);
+   std::uniform_int_distribution<memory_unit> large(-1'000'000'000'000, 1'000'000'000'000);
+
+   std::string text;
+   for (size_t i = 0; i < count; ++i)
+   {
+      int const k = kind(random);
+      memory_unit const value = k < 7 ? small(random) : k < 9 ? -small(random) : large(random);
+      text += (i > 0 ? "," : "") + std::to_string(value);
+   }
+   text += "\n";
+
+   return text;
+}
+
+void check_parser()
+{
+   if (read_program(" 1, -2 ,3\r\n") != memory_t{ 1, -2, 3 } || !read_program("\n").empty() ||
+      read_program("109,-9223372036854775807,99") != memory_t{ 109, -9223372036854775807, 99 })
+      throw std::runtime_error("unexpected parse");
+
+   for (auto const bad : { "1,,2", "1,2,", "1;2", "12a", "99999999999999999999" })
+   {
+      try
+      {
+         read_program(bad);
+         throw std::logic_error(std::string("invalid text accepted: ") + bad);
+      }
+      catch (std::runtime_error const&)
+      {
+      }
+   }
+}
+
+template <typename Parse>
+memory_unit parse_checksum(std::string const& text, Parse parse)
+{
+   memory_unit sum = 0;
+   for (memory_unit const value : parse(text))
+      sum = sum * 31 + value;
+   return sum;
+}
+
+// the inputs of the day 19 part 1 runs, one per point of the grid
+std::vector<memory_t> beam_grid(int const size)
+{
+   std::vector<memory_t> inputs;
+   for (int y = 0; y < size; ++y)
+   {
+      for (int x = 0; x < size; ++x)
+         inputs.push_back({ x, y });
+   }
+   return inputs;
+}
+
+int count_beam_points(std::vector<memory_t> const& outputs)
+{
+   return static_cast<int>(std::count_if(outputs.begin(), outputs.end(), [](memory_t const& output) {
+      return output.size() == 1 && output[0] == 1; }));
+}
+
+// day 19 part 1 as one batch of runs in lockstep
+int run_beam_batch(memory_t const& memory, batch_stats_t& stats)
+{
+   return count_beam_points(run_batch(memory, beam_grid(50), stats));
+}
+
+// day 19 part 1 with the runs spread over the threads of a pool
+int run_beam_parallel(thread_pool_t& pool, memory_t const& memory, int const size)
+{
+   return count_beam_points(run_parallel(pool, memory, beam_grid(size)));
+}
+
+// the program the engine checks run: reads values until a 0 and, for each,
+// adds value + (value - 1) + ... + 1 to a running sum and outputs it. with
+// far, a 12 is first copied out through a cell a million cells up; with
+// trap, a 13 jumps to a cell that is not an instruction
+memory_t summing_program(bool const far = false, bool const trap = false)
+{
+   std::string source =
+      "loop:  in    [value]\n"
+      "       jz    [value], end\n";
+   if (trap)
+      source +=
+      "       eq    [value], 13, [tmp]\n"
+      "       jnz   [tmp], bad\n";
+   if (far)
+      source +=
+      "       eq    [value], 12, [tmp]\n"
+      "       jz    [tmp], count\n"
+      "       bso   1000000\n"
+      "       add   [value], 0, [base+5]\n"
+      "       out   [base+5]\n"
+      "       bso   -1000000\n";
+   source +=
+      "count: add   [sum], [value], [sum]\n"
+      "       add   [value], -1, [value]\n"
+      "       jnz   [value], count\n"
+      "       out   [sum]\n"
+      "       jnz   1, loop\n"
+      "end:   hlt\n"
+      "bad:   data  0\n"
+      "value: data  0\n"
+      "sum:   data  0\n"
+      "tmp:   data  0\n";
+   return assemble(source);
+}
+
+// up to max_values values below range, then the 0 that ends the run if terminated
+memory_t random_input(std::mt19937& random, size_t const max_values, memory_unit const range, bool const terminated)
+{
+   memory_t input;
+   for (size_t k = 0; k < 1 + random() % max_values; ++k)
+      input.push_back(random() % range);
+   if (terminated) input.push_back(0);
+   return input;
+}
+
+// the outputs program_t gives for each input
+std::vector<memory_t> expected_outputs(memory_t const& memory, std::vector<memory_t> const& inputs)
+{
+   std::vector<memory_t> expected(inputs.size());
+   for (size_t i = 0; i < inputs.size(); ++i)
+      program_t{ memory }.run(inputs[i], expected[i]);
+   return expected;
+}
+
+// machines that loop a different number of times, run out of input or
+// address far memory must end up with the outputs program_t gives them
+void check_batch()
+{
+   auto const memory = summing_program(true);
+
+   std::mt19937 random{ 19 };
+   std::vector<memory_t> inputs(100);
+   for (size_t i = 0; i < inputs.size(); ++i)
+      inputs[i] = random_input(random, 5, 16, i % 7 != 0);
+
+   batch_stats_t stats;
+   if (run_batch(memory, inputs, stats) != expected_outputs(memory, inputs))
+      throw std::runtime_error("batch run differs from program_t");
+
+   // a lane addressing far memory leaves the group on its own
+   auto const spread = assemble(
+      "       in    [offset]\n"
+      "       bso   [offset]\n"
+      "       add   [base+0], 1, [base+0]\n"
+      "       out   [base+0]\n"
+      "       hlt\n"
+      "offset: data  0\n");
+
+   std::vector<memory_t> offsets;
+   for (memory_unit l = 0; l < static_cast<memory_unit>(BATCH_LANES); ++l)
+      offsets.push_back({ l == 3 ? 1000000 : 100 + l });
+
+   batch_stats_t spread_stats;
+   if (run_batch(spread, offsets, spread_stats) != std::vector<memory_t>(BATCH_LANES, memory_t{ 1 }) || spread_stats.peeled != 1)
+      throw std::runtime_error("batch peeled off more than the lane out of range");
+
+   std::cout << "batch: " << stats.machines << " machines, " << stats.peeled << " peeled off, "
+      << (stats.vectorized ? "AVX2 add/lt/eq" : "scalar") << " lanes\n";
+}
+
+// every run must end up with the outputs program_t gives it, whatever the
+// size of the pool, and a run that throws must reach the caller
+void check_parallel()
+{
+   auto const memory = summing_program(false, true);
+
+   std::mt19937 random{ 20 };
+   std::vector<memory_t> inputs(1000);
+   for (auto& input : inputs)
+      input = random_input(random, 5, 13, random() % 3 != 0);
+
+   auto const expected = expected_outputs(memory, inputs);
+
+   for (size_t const threads : { 1, 3, 8 })
+   {
+      thread_pool_t pool(threads);
+      if (run_parallel(pool, memory, inputs) != expected)
+         throw std::runtime_error("parallel run differs from program_t");
+
+      // 13 sends the machine to a cell that is not an instruction
+      auto failing = inputs;
+      failing[failing.size() / 2] = { 13 };
+
+      bool thrown = false;
+      try
+      {
+         run_parallel(pool, memory, failing);
+      }
+      catch (std::runtime_error const&)
+      {
+         thrown = true;
+      }
+      if (!thrown)
+         throw std::runtime_error("parallel run lost an exception");
+
+      // the pool is still usable after a job threw
+      if (run_parallel(pool, memory, inputs) != expected)
+         throw std::runtime_error("parallel run differs after an exception");
+   }
+
+   std::cout << "parallel: " << inputs.size() << " machines on pools of 1, 3 and 8 threads\n";
+}
+
+// a coroutine machine fed one input at a time must give the outputs
+// program_t gives it for all of them at once, and an engine error must
+// come out of resume. a 12 makes two outputs in a row
+void check_coroutine()
+{
+   auto const memory = summing_program(true, true);
+
+   std::mt19937 random{ 21 };
+   for (int run = 0; run < 100; ++run)
+   {
+      memory_t input;
+      for (size_t k = 0; k < 1 + random() % 8; ++k)
+         input.push_back(1 + random() % 12);
+      input.push_back(0);
+
+      memory_t expected;
+      program_t{ memory }.run(input, expected);
+
+      auto machine = run_machine(program_t{ memory });
+      memory_t output;
+      size_t sent = 0;
+
+      machine_state_t state;
+      while ((state = machine.resume()) != machine_state_t::halted)
+      {
+         if (state == machine_state_t::output)
+            output.push_back(machine.output());
+         else if (sent < input.size())
+            machine.send(input[sent++]);
+         else
+            throw std::runtime_error("coroutine machine waits for input past the end");
+      }
+
+      if (output != expected || sent != input.size())
+         throw std::runtime_error("coroutine machine differs from program_t");
+   }
+
+   // 13 sends the machine to a cell that is not an instruction
+   auto machine = run_machine(program_t{ memory });
+   machine.send(13);
+
+   bool thrown = false;
+   try
+   {
+      machine.resume();
+   }
+   catch (std::runtime_error const&)
+   {
+      thrown = true;
+   }
+   if (!thrown || !machine.is_halted() || machine.resume() != machine_state_t::halted)
+      throw std::runtime_error("coroutine machine lost an exception");
+}
+
+// passes a token laps times around a ring of coroutine machines that each
+// add one to it, all on this thread
+memory_unit run_ring(memory_t const& memory, int const count, int const laps)
+{
+   program_t const prototype{ memory };
+   std::vector<machine_coroutine_t> machines;
+   for (int i = 0; i < count; ++i)
+      machines.push_back(run_machine(prototype.fork()));
+
+   memory_unit token = 0;
+   machines.front().send(token);
+
+   for (int lap = 0; lap < laps; ++lap)
+   {
+      for (int i = 0; i < count; ++i)
+      {
+         while (machines[i].resume() == machine_state_t::output)
+         {
+            token = machines[i].output();
+            machines[(i + 1) % count].send(token);
+         }
+      }
+   }
+
+   return token;
+}
+
+// cached results must be the outputs program_t gives, through evictions,
+// and runs that stop for input must not be remembered
+void check_memo()
+{
+   auto const memory = summing_program();
+
+   run_cache_t cache{ program_t{ memory }, 8 };
+
+   std::mt19937 random{ 22 };
+   for (int run = 0; run < 1000; ++run)
+   {
+      memory_t const input = random_input(random, 2, 5, random() % 4 != 0);
+
+      memory_t expected;
+      program_t{ memory }.run(input, expected);
+
+      if (cache.run(input) != expected)
+         throw std::runtime_error("cached run differs from program_t");
+      if (cache.size() > 8)
+         throw std::runtime_error("cache outgrew its capacity");
+   }
+
+   auto const& stats = cache.stats();
+   if (stats.hits == 0 || stats.evictions == 0 || stats.uncached == 0 || stats.hits + stats.misses != 1000)
+      throw std::runtime_error("cache counters are off");
+
+   std::cout << "memo: " << stats.hits << " hits, " << stats.misses << " misses, "
+      << stats.evictions << " evictions, " << stats.uncached << " not halted\n";
+}
+
+// day 19 part 1 asked passes times over, through a cache or not
+template <typename Probe>
+int run_beam_probes(int const passes, Probe probe)
+{
+   int points = 0;
+   for (int pass = 0; pass < passes; ++pass)
+   {
+      for (int y = 0; y < 50; ++y)
+      {
+         for (int x = 0; x < 50; ++x)
+         {
+            auto const& output = probe(memory_t{ x, y });
+            points += output.size() == 1 && output[0] == 1;
+         }
+      }
+   }
+   return points;
+}
+
+// a program that loops setup times before it reads anything, then outputs
+// every value it reads multiplied by the result of the setup; the mul keeps
+// the setup from being run as a counted loop
+memory_t setup_program(int const setup)
+{
+   return assemble(
+      "       out   7\n"
+      "setup: add   [count], -1, [count]\n"
+      "       add   [acc], 3, [acc]\n"
+      "       mul   [acc], 1, [acc]\n"
+      "       jnz   [count], setup\n"
+      "       out   [acc]\n"
+      "loop:  in    [value]\n"
+      "       jz    [value], end\n"
+      "       mul   [value], [acc], [value]\n"
+      "       out   [value]\n"
+      "       jnz   1, loop\n"
+      "end:   hlt\n"
+      "count: data  " + std::to_string(setup) + "\n"
+      "acc:   data  0\n"
+      "value: data  0\n");
+}
+
+// a run from the checkpoint must be a run from the start, also when its
+// output limit stops it before the checkpoint or it halts before any IN
+void check_checkpoint()
+{
+   auto const memory = setup_program(100);
+
+   checkpoint_t const start{ program_t{ memory } };
+   if (start.prefix_output() != memory_t{ 7, 300 } || start.skipped() == 0)
+      throw std::runtime_error("checkpoint is not at the first IN");
+
+   memory_t const inputs[] = { {}, { 0 }, { 2, 5 }, { 2, 5, 0 }, { 1, 2, 3, 4 } };
+   for (auto const& input : inputs)
+   {
+      for (size_t const max_output : { size_t{ 0 }, size_t{ 1 }, size_t{ 2 }, size_t{ 3 }, std::numeric_limits<size_t>::max() })
+      {
+         memory_t expected;
+         auto const fresh = program_t{ memory }.run(input, expected, max_output);
+
+         memory_t output;
+         auto const resumed = start.run(input, output, max_output);
+
+         if (output != expected || resumed.status != fresh.status || resumed.consumed != fresh.consumed)
+            throw std::runtime_error("run from the checkpoint differs from a fresh run");
+      }
+   }
+
+   checkpoint_t const halted{ program_t{ 104, 1, 99 } };
+   memory_t output;
+   if (halted.run({}, output).status != run_status_t::halted || output != memory_t{ 1 })
+      throw std::runtime_error("checkpoint of a program without input is off");
+}
+
+// day 21 part 1: the droid walks with a springscript
+memory_t const walk_script = [] {
+   std::string const script = "OR A J\nAND B J\nAND C J\nNOT J J\nAND D J\nWALK\n";
+   return memory_t(script.begin(), script.end()); }();
+
+// runs the program one instruction at a time, which never takes a loop
+// in closed form; gives up after limit instructions
+memory_t run_stepwise(program_t& program, uint64_t const limit)
+{
+   memory_t output;
+   auto fin = []() -> memory_unit { throw std::runtime_error("unexpected input"); };
+   auto fout = [&output](memory_unit const value) { output.push_back(value); return false; };
+
+   while (!program.step(fin, fout) && program.instructions() < limit) {}
+   return output;
+}
+
+// a random loop of additions over a few cells: mostly loops that can run in
+// closed form, and some that cannot because a cell steps by another cell
+// the body writes, an add is not of the cell += k form, a mul sneaks in or
+// the body writes its own code. the counter is set so the loop ends
+std::string random_loop(std::mt19937& random)
+{
+   int const cells = 4;
+   std::string body;
+
+   memory_unit stride = 0;
+   for (int k = 0; k < 1 + static_cast<int>(random() % 2); ++k)
+   {
+      memory_unit const step = static_cast<memory_unit>(random() % 7) - 3;
+      stride += step;
+      body += "       add   [count], " + std::to_string(step) + ", [count]\n";
+   }
+   if (stride == 0)
+   {
+      stride = -1;
+      body += "       add   [count], -1, [count]\n";
+   }
+
+   for (int k = 0; k < static_cast<int>(random() % 6); ++k)
+   {
+      std::string const cell = "[c" + std::to_string(random() % cells) + "]";
+      std::string const other = "[c" + std::to_string(random() % cells) + "]";
+      std::string const value = std::to_string(static_cast<memory_unit>(random() % 2001) - 1000);
+
+      switch (random() % 10)
+      {
+      case 0:  body += "       add   " + other + ", " + cell + ", " + cell + "\n"; break;
+      case 1:  body += "       add   " + cell + ", " + other + ", " + cell + "\n"; break;
+      case 2:  body += "       add   " + cell + ", [big], " + cell + "\n"; break;
+      case 3:  body += "       add   " + other + ", " + value + ", " + cell + "\n"; break;
+      case 4:  body += "       mul   " + cell + ", 1, " + cell + "\n"; break;
+      case 5:  body += "       add   [loop], 0, [loop]\n"; break;
+      default: body += "       add   " + cell + ", " + value + ", " + cell + "\n"; break;
+      }
+   }
+
+   memory_unit const iterations = 1 + random() % 300;
+   std::string text = "loop:\n" + body +
+      "       jnz   [count], loop\n";
+   for (int c = 0; c < cells; ++c)
+      text += "       out   [c" + std::to_string(c) + "]\n";
+   text += "       out   [count]\n"
+      "       hlt\n"
+      "count: data  " + std::to_string(-stride * iterations) + "\n"
+      "big:   data  4611686018427387904\n";
+   for (int c = 0; c < cells; ++c)
+      text += "c" + std::to_string(c) + ":    data  " + std::to_string(static_cast<memory_unit>(random() % 201) - 100) + "\n";
+
+   return text;
+}
+
+// loops run in closed form must leave memory, outputs and the instruction
+// count exactly as interpreting them does
+void check_counted_loops()
+{
+   std::mt19937 random{ 24 };
+   size_t accelerated = 0;
+
+   for (int run = 0; run < 2000; ++run)
+   {
+      auto const memory = assemble(random_loop(random));
+
+      program_t plain{ memory };
+      auto const expected = run_stepwise(plain, 100'000'000);
+
+      // both dispatch loops take the loops in closed form
+      program_t fast{ memory };
+      memory_t output;
+      auto fin = []() {return memory_unit{ 0 }; };
+      auto fout = [&output](memory_unit const value) {output.push_back(value); return false; };
+      if (run % 2 == 0)
+         fast.run({}, output);
+      else
+         fast.execute_switch(fin, fout);
+
+      if (!plain.is_halted() || output != expected || fast.instructions() != plain.instructions())
+         throw std::runtime_error("counted loop differs from interpretation");
+
+      for (offset_t off = 0; off < static_cast<offset_t>(memory.size()); ++off)
+      {
+         if (fast.read(off) != plain.read(off))
+            throw std::runtime_error("counted loop leaves memory differently");
+      }
+
+      accelerated += fast.fusion_counters().counted_loops;
+   }
+
+   std::cout << "counted loops: " << accelerated << " of 2000 random loops run in closed form\n";
+}
+
+// runs the program in slices of budget instructions until it halts
+memory_t run_sliced(program_t& program, memory_t const& input, uint64_t const budget)
+{
+   memory_t output;
+   std::span<memory_unit const> pending{ input };
+
+   while (true)
+   {
+      uint64_t const before = program.instructions();
+      auto const result = program.run_for(budget, pending, output);
+      pending = pending.subspan(result.consumed);
+
+      if (result.status == run_status_t::halted)
+         return output;
+      if (result.status != run_status_t::budget_spent)
+         throw std::runtime_error("sliced run stopped early");
+
+      // a superinstruction may take the slice one over its budget
+      uint64_t const spent = program.instructions() - before;
+      if (spent != budget && spent != budget + 1)
+         throw std::runtime_error("sliced run did not keep to its budget");
+   }
+}
+
+// a program run in slices must end as it does when run in one go, and a
+// machine that never stops must still give control back
+void check_budget(memory_t const& boost)
+{
+   program_t whole{ boost };
+   memory_t expected;
+   whole.run(memory_t{ 2 }, expected);
+
+   for (uint64_t const budget : { 1, 2, 3, 1000, 100000 })
+   {
+      program_t sliced{ boost };
+      if (run_sliced(sliced, memory_t{ 2 }, budget) != expected || sliced.instructions() != whole.instructions())
+         throw std::runtime_error("sliced run differs from whole run");
+   }
+
+   // jmp 0: spins forever
+   memory_t const spin{ 1105, 1, 0 };
+   program_t spinner{ spin };
+   memory_t output;
+   for (int slice = 1; slice <= 3; ++slice)
+   {
+      if (spinner.run_for(1000, {}, output).status != run_status_t::budget_spent ||
+          spinner.instructions() < slice * 1000u || spinner.instructions() > slice * 1001u)
+         throw std::runtime_error("spinning program not preempted");
+   }
+
+   auto machine = run_machine(program_t{ spin });
+   if (machine.resume(1000) != machine_state_t::preempted || machine.resume(1000) != machine_state_t::preempted)
+      throw std::runtime_error("spinning coroutine not preempted");
+
+   // counted loops in closed form stop part way through at the budget
+   std::mt19937 random{ 25 };
+   for (int run = 0; run < 500; ++run)
+   {
+      auto const memory = assemble(random_loop(random));
+
+      program_t plain{ memory };
+      auto const expected_loop = run_stepwise(plain, 100'000'000);
+
+      program_t sliced{ memory };
+      if (run_sliced(sliced, {}, 1 + random() % 5000) != expected_loop || sliced.instructions() != plain.instructions())
+         throw std::runtime_error("sliced counted loop differs from interpretation");
+
+      for (offset_t off = 0; off < static_cast<offset_t>(memory.size()); ++off)
+      {
+         if (sliced.read(off) != plain.read(off))
+            throw std::runtime_error("sliced counted loop leaves memory differently");
+      }
+   }
+}
+
+// a counted loop of sixteen instructions that, in a block of its own,
+// writes the opcode of an instruction back on every iteration; it reads the
+// iteration count and outputs the accumulator
+memory_t self_modifying_loop()
+{
+   std::string source = "       in    [count]\nloop:\n";
+   for (int i = 0; i < 8; ++i)
+      source += "       add   [acc], 3, [acc]\n       mul   [acc], 1, [tmp]\n";
+   source +=
+      "       jnz   1, patch\n"
+      "patch: add   [opcode], 0, [patch]\n"
+      "       add   [count], -1, [count]\n"
+      "       jnz   [count], loop\n"
+      "       out   [acc]\n"
+      "       hlt\n"
+      "count: data  0\n"
+      "acc:   data  0\n"
+      "tmp:   data  0\n"
+      "opcode: data 1001\n";
+
+   return assemble(source);
+}
+
+// compiled blocks must count instructions as the interpreter does, keep to
+// budgets, leave traces to the interpreter and survive code that rewrites itself
+void check_jit(memory_t const& boost)
+{
+   program_t whole{ boost };
+   memory_t expected;
+   whole.run(memory_t{ 2 }, expected);
+
+   auto fin = []() {return memory_unit{ 2 }; };
+   memory_t output;
+   auto fout = [&output](memory_unit const value) {output.push_back(value); return false; };
+
+   jit_program_t jit{ boost };
+   jit.execute(fin, fout);
+   if (output != expected || jit.instructions() != whole.instructions())
+      throw std::runtime_error("jit counts instructions differently");
+
+   for (uint64_t const budget : { 1, 7, 1000 })
+   {
+      output.clear();
+      jit_program_t sliced{ boost };
+      while (true)
+      {
+         uint64_t const before = sliced.instructions();
+         if (!sliced.execute_for(budget, fin, fout))
+            break;
+         if (sliced.instructions() - before != budget)
+            throw std::runtime_error("jit did not keep to its budget");
+      }
+      if (!sliced.is_halted() || output != expected || sliced.instructions() != whole.instructions())
+         throw std::runtime_error("sliced jit run differs from whole run");
+   }
+
+   auto const count = []() {return memory_unit{ 1000 }; };
+   program_t plain{ self_modifying_loop() };
+   memory_t plain_output;
+   trace_writer_t plain_trace{ 4 };
+   plain.set_trace(&plain_trace);
+   plain.run(memory_t{ 1000 }, plain_output);
+
+   output.clear();
+   jit_program_t compiled{ self_modifying_loop() };
+   compiled.execute(count, fout);
+   if (output != plain_output || compiled.instructions() != plain.instructions() || compiled.compiled_blocks() == 0)
+      throw std::runtime_error("jit run of self-modifying code differs");
+
+   output.clear();
+   jit_program_t traced{ self_modifying_loop() };
+   trace_writer_t trace{ 4 };
+   traced.set_trace(&trace);
+   traced.execute(count, fout);
+   if (output != plain_output || trace.recent().size() != 1 || trace.recent()[0].instruction != plain_trace.recent()[0].instruction)
+      throw std::runtime_error("traced jit run differs");
+}
+
+// a counted loop around unrolled copies of body, for timing an instruction
+// mix; it reads the iteration count and outputs the accumulator
+memory_t synthetic_loop(std::string_view body, int const unroll)
+{
+   std::string source = "      bso   stack\n      in    [count]\nloop:\n";
+   for (int i = 0; i < unroll; ++i)
+      source += body;
+   source +=
+      "      add   [count], -1, [count]\n"
+      "      jnz   [count], loop\n"
+      "done:  out   [acc]\n"
+      "      hlt\n"
+      "count: data  0\n"
+      "acc:   data  0\n"
+      "tmp:   data  0\n"
+      "stack: data  0, 0\n";
+
+   return assemble(source);
+}
+
+template <typename Program, typename Execute>
+memory_unit run_synthetic(Program program, Execute execute, memory_unit const iterations)
+{
+   memory_unit result = 0;
+   execute(program,
+      [iterations]() {return iterations; },
+      [&result](memory_unit const value) {result = value; return false; });
+   return result;
+}
+
+// the assembler must produce the same image as the hand encoded program and
+// reject undefined labels
+void check_assembler()
+{
+   auto const memory = assemble(
+      "start: in    [value]      ; read a number\n"
+      "       mul   [value], 2, [value]\n"
+      "       jz    [value], end\n"
+      "       bso   base-3\n"
+      "       out   [base+value]\n"
+      "end:   hlt\n"
+      "value: data  0, end+1, -start\n");
+
+   if (memory != memory_t{ 3, 14, 1002, 14, 2, 14, 1006, 14, 13, 109, -3, 204, 14, 99, 0, 14, 0 })
+      throw std::runtime_error("unexpected assembled image");
+
+   // disassembler output, address column and all
+   auto const listed = assemble(
+      "0000 in   [14]\n"
+      "0002 mul  [14], 2, [14]\n"
+      "0006 jz   [14], 13\n"
+      "0009 bso  base-3\n"
+      "000b out  [base+14]\n"
+      "000d hlt  \n"
+      "000e data 0\n"
+      "000f data 14\n"
+      "0010 data 0\n");
+
+   if (listed != memory)
+      throw std::runtime_error("disassembler output does not assemble back");
+
+   try
+   {
+      assemble("jnz 1, nowhere");
+      throw std::logic_error("undefined label accepted");
+   }
+   catch (std::runtime_error const&)
+   {
+   }
+
+   std::cout << "assembler: " << memory.size() << " cells\n";
+}
+
+void print_fusions(std::string_view name, program_t const& program)
+{
+   auto const& counters = program.fusion_counters();
+
+   std::cout << name << ": "
+      << "lt+jump " << counters.less_jump << ", "
+      << "eq+jump " << counters.equal_jump << ", "
+      << "rbo+jump " << counters.baseoff_jump << ", "
+      << "counted loops " << counters.counted_loops << '\n';
+}
+
+// forks share every page until they write to it: the pages alive must grow
+// with the pages the forks dirtied, not with the number of forks
+void check_fork_sharing(memory_t const& memory, int const forks)
+{
+   size_t const before = memory_page_t::live;
+
+   program_t root{ memory };
+   size_t const image = memory_page_t::live - before;
+
+   std::vector<program_t> machines;
+   for (int i = 0; i < forks; ++i)
+      machines.push_back(root.fork());
+
+   if (memory_page_t::live - before != image)
+      throw std::runtime_error("forking copied pages");
+
+   // every fork dirties one page of the image; half of them also one page of fresh memory
+   for (int i = 0; i < forks; ++i)
+   {
+      machines[i].write(0, i);
+      if (i % 2 == 0) machines[i].write(1 << 20, i);
+   }
+
+   size_t const expected = image + forks + forks / 2;
+   if (memory_page_t::live - before != expected)
+      throw std::runtime_error("unexpected number of pages after writes");
+
+   for (int i = 0; i < forks; ++i)
+   {
+      if (machines[i].read(0) != i || root.read(0) != memory[0])
+         throw std::runtime_error("forks are not isolated");
+   }
+
+   std::cout << forks << " forks of a " << image << " page image: " << memory_page_t::live - before << " pages\n";
+}
+
+// writes scattered near 2^40 must cost one page each, both from the host
+// and from a program addressing them through the relative base
+void check_sparse_memory()
+{
+   constexpr memory_unit far = memory_unit{ 1 } << 40;
+   size_t const before = memory_page_t::live;
+
+   // rb = 2^40 - 5; [rb+5] = 7 * 6; out [rb+5]; [rb-1000000] = 1; out [rb-1000000]
+   program_t program{ 109, far - 5, 21102, 7, 6, 5, 204, 5, 21101, 0, 1, -1000000, 204, -1000000, 99 };
+   memory_t outputs;
+   program.run({}, outputs);
+   if (outputs != memory_t{ 42, 1 })
+      throw std::runtime_error("unexpected output at far addresses");
+
+   for (memory_unit i = 0; i < 1000; ++i)
+      program.write(far + i * (memory_unit{ 1 } << 20), i);
+
+   for (memory_unit i = 0; i < 1000; ++i)
+   {
+      if (program.read(far + i * (memory_unit{ 1 } << 20)) != i || program.read(far + i * (memory_unit{ 1 } << 20) + 1) != 0)
+         throw std::runtime_error("unexpected value at far addresses");
+   }
+
+   size_t const pages = memory_page_t::live - before;
+   if (pages > 1 + 2 + 1000)
+      throw std::runtime_error("far writes allocated too many pages");
+
+   std::cout << "1002 writes near 2^40: " << pages << " pages\n";
+}
+
+// a run recorded through the fast loop must replay to the same outputs, and
+// seeking back through the snapshots must land on the same state as
+// stepping a fresh machine to that point
+void check_trace_replay()
+{
+   auto const memory = summing_program();
+
+   memory_t inputs;
+   for (memory_unit i = 1; i <= 200; ++i)
+      inputs.push_back(i * 7 % 100);
+   inputs.push_back(0);
+
+   std::stringstream log;
+   memory_t expected;
+   uint64_t executed = 0;
+   {
+      trace_writer_t writer{ log, 16 };
+      program_t program{ memory };
+      program.set_trace(&writer);
+      program.run(inputs, expected);
+      executed = program.instructions();
+   }
+
+   trace_replay_t replay{ memory, read_trace(log), 1000, 8 };
+   memory_t outputs;
+   replay.run([&outputs](memory_unit const value) {outputs.push_back(value); });
+   if (outputs != expected || replay.position() != executed || !replay.machine().is_halted())
+      throw std::runtime_error("replay differs from the recorded run");
+
+   for (uint64_t const target : { executed / 2, executed / 3, executed - 1, uint64_t{ 5 } })
+   {
+      replay.seek(target);
+
+      struct input_t
+      {
+         memory_t const& values;
+         size_t          next = 0;
+         memory_unit operator()() { return values[next++]; }
+      } fin{ inputs };
+      auto fout = [](memory_unit const) {return false; };
+
+      program_t program{ memory };
+      while (program.instructions() < target)
+         program.step(fin, fout);
+
+      program_t& machine = replay.machine();
+      bool same = machine.get_ip() == program.get_ip() && replay.inputs_consumed() == fin.next;
+      for (size_t off = 0; off < memory.size(); ++off)
+         same = same && machine.read(static_cast<offset_t>(off)) == program.read(static_cast<offset_t>(off));
+      if (!same)
+         throw std::runtime_error("seek does not reproduce the recorded state");
+   }
+
+   // an input consumed at another point than recorded must be reported
+   std::stringstream copy{ log.str() };
+   auto entries = read_trace(copy);
+   entries[10].instruction++;
+   try
+   {
+      trace_replay_t diverging{ memory, entries };
+      diverging.run([](memory_unit) {});
+      throw std::logic_error("diverging replay accepted");
+   }
+   catch (std::runtime_error const&)
+   {
+   }
+
+   std::cout << "trace: " << inputs.size() << " inputs over " << executed << " instructions in " << log.str().size() << " bytes, "
+      << replay.snapshot_count() << " snapshots kept\n";
+}
+
+// a program loaded through the image cache must match the text, run the
+// same, and leave the mapped image untouched when the machine writes to it
+void check_program_image(std::string const& path, memory_t const& memory, memory_unit const expected)
+{
+   auto const cache = (std::filesystem::temp_directory_path() / "intbench_cache").string();
+   std::filesystem::remove_all(cache);
+
+   auto const image = load_cached_program(path, cache);
+   auto const cached = load_cached_program(path, cache);
+   if (image.to_memory() != memory || cached.source_hash() != image.source_hash() ||
+      std::distance(std::filesystem::directory_iterator(cache), std::filesystem::directory_iterator{}) != 1)
+      throw std::runtime_error("unexpected cached image");
+
+   program_t program{ cached };
+   if (run_boost(program, [](program_t& program, auto fin, auto fout) {program.execute(fin, fout); }) != expected)
+      throw std::runtime_error("unexpected result from an image");
+
+   program.write(0, -1);
+   if (image[0] != memory[0] || program_t{ image }.read(0) != memory[0])
+      throw std::runtime_error("writes reached the mapped image");
+
+   // a text that changes size gets an image of its own
+   auto const copy = (std::filesystem::path(cache) / "program.txt").string();
+   std::ofstream(copy) << "1101,2,3,0,99";
+   auto const first = load_cached_program(copy, cache);
+   std::ofstream(copy) << "1101,2,3,0,99,0";
+   auto const second = load_cached_program(copy, cache);
+   if (first.size() != 5 || second.size() != 6)
+      throw std::runtime_error("cached image of a changed text");
+
+   // concurrent loads of a file not in the cache all get the whole image
+   std::filesystem::remove_all(cache);
+   std::vector<std::thread> loaders;
+   std::atomic<int> wrong = 0;
+   for (int i = 0; i < 4; ++i)
+      loaders.emplace_back([&]() {if (load_cached_program(path, cache).to_memory() != memory) ++wrong; });
+   for (auto& loader : loaders) loader.join();
+   if (wrong != 0 || std::distance(std::filesystem::directory_iterator(cache), std::filesystem::directory_iterator{}) != 1)
+      throw std::runtime_error("unexpected image from concurrent loads");
+
+   measure("day 09 load, text", 200, memory.size(), [&]() {return load_program(path).size(); });
+   measure("day 09 load, cached image", 200, memory.size(), [&]() {return load_cached_program(path, cache).size(); });
+
+   std::filesystem::remove_all(cache);
+}
+
+int main()
+{
+   auto boost = load_program("..\\data\\aoc2019_09_input1.txt");
+   auto beam = load_program("..\\data\\aoc2019_19_input1.txt");
+
+   auto l_switch = [](program_t& program, auto fin, auto fout) {program.execute_switch(fin, fout); };
+#if INTCODE_THREADED_DISPATCH
+   auto l_threaded = [](program_t& program, auto fin, auto fout) {program.execute_threaded(fin, fout); };
+#endif
+   auto l_erased = [](program_t& program, auto fin, auto fout) {program.execute(program_t::input_t{ fin }, program_t::output_t{ fout }); };
+   auto l_execute = [](auto& program, auto fin, auto fout) {program.execute(fin, fout); };
+
+   // dispatch
+   {
+      auto expected_boost = run_boost(program_t{ boost }, l_switch);
+      auto expected_beam = run_beam(program_t{ beam }, l_switch);
+
+      auto const switch_boost = measure("day 09 BOOST, switch dispatch", 50, expected_boost, [&]() {return run_boost(program_t{ boost }, l_switch); });
+#if INTCODE_THREADED_DISPATCH
+      auto const threaded_boost = measure("day 09 BOOST, threaded dispatch", 50, expected_boost, [&]() {return run_boost(program_t{ boost }, l_threaded); });
+#endif
+      measure("day 09 BOOST, std::function handlers", 50, expected_boost, [&]() {return run_boost(program_t{ boost }, l_erased); });
+      measure("day 09 BOOST, jit", 50, expected_boost, [&]() {return run_boost(jit_program_t{ boost }, l_execute); });
+      measure("day 09 BOOST, aot", 50, expected_boost, [&]() {return run_boost(boost_program_t{}, l_execute); });
+
+      auto const switch_beam = measure("day 19 beam, switch dispatch", 20, expected_beam, [&]() {return run_beam(program_t{ beam }, l_switch); });
+#if INTCODE_THREADED_DISPATCH
+      auto const threaded_beam = measure("day 19 beam, threaded dispatch", 20, expected_beam, [&]() {return run_beam(program_t{ beam }, l_threaded); });
+#endif
+      measure("day 19 beam, std::function handlers", 20, expected_beam, [&]() {return run_beam(program_t{ beam }, l_erased); });
+      measure("day 19 beam, jit", 20, expected_beam, [&]() {return run_beam(jit_program_t{ beam }, l_execute); });
+      measure("day 19 beam, aot", 20, expected_beam, [&]() {return run_beam(beam_program_t{}, l_execute); });
+
+#if INTCODE_THREADED_DISPATCH
+      // execute uses the switch; this shows whether that still holds
+      std::cout << "threaded dispatch: " << std::setprecision(0) << 100.0 * threaded_boost / switch_boost << "% of the switch time on BOOST, "
+         << 100.0 * threaded_beam / switch_beam << "% on beam" << (threaded_boost > switch_boost || threaded_beam > switch_beam ? ", slower\n" : "\n")
+         << std::setprecision(3);
+#else
+      (void)switch_boost; (void)switch_beam;
+#endif
+
+      check_batch();
+
+      batch_stats_t stats;
+      measure("day 19 beam, lockstep batch", 20, expected_beam, [&]() {return run_beam_batch(beam, stats); });
+      std::cout << "lockstep: " << stats.steps / 20 << " steps, " << std::setprecision(1)
+         << 100.0 * stats.lane_instructions / (stats.steps * BATCH_LANES) << "% of the lanes busy, "
+         << stats.peeled / 20 << " of " << stats.machines / 20 << " machines peeled off\n" << std::setprecision(3);
+
+      check_parallel();
+
+      thread_pool_t single(1);
+      thread_pool_t pool;
+      auto const expected_grid = run_beam_parallel(single, beam, 200);
+      std::cout << "thread pool: " << pool.size() << " threads\n";
+      measure("day 19 beam 200x200, 1 thread", 5, expected_grid, [&]() {return run_beam_parallel(single, beam, 200); });
+      measure("day 19 beam 200x200, thread pool", 5, expected_grid, [&]() {return run_beam_parallel(pool, beam, 200); });
+
+      check_coroutine();
+
+      auto const ring = assemble(
+         "loop:  in    [value]\n"
+         "       add   [value], 1, [value]\n"
+         "       out   [value]\n"
+         "       jnz   1, loop\n"
+         "value: data  0\n");
+      measure("coroutine ring, 10000 machines x 10", 5, memory_unit{ 100000 }, [&]() {return run_ring(ring, 10000, 10); });
+
+      check_memo();
+
+      program_t const drone{ beam };
+      auto const expected_probes = 4 * expected_beam;
+      measure("day 19 beam x4, program_t", 5, expected_probes, [&]() {
+         return run_beam_probes(4, [&](memory_t const& input) {
+            memory_t output;
+            drone.fork().run(input, output);
+            return output; }); });
+      measure("day 19 beam x4, run cache", 5, expected_probes, [&]() {
+         run_cache_t cache{ drone };
+         return run_beam_probes(4, [&](memory_t const& input) -> memory_t const& { return cache.run(input); }); });
+   }
+
+   // parsing
+   {
+      check_parser();
+
+      std::string const text = generate_program_text(1'000'000);
+      auto const expected = parse_checksum(text, read_program_atoll);
+      std::cout << "generated program: " << text.size() / (1024 * 1024.0) << " MB\n";
+
+      measure("parse, find + atoll", 10, expected, [&]() {return parse_checksum(text, read_program_atoll); });
+      measure("parse, read_program", 10, expected, [&]() {return parse_checksum(text, read_program); });
+   }
+
+   // synthetic instruction mixes
+   {
+      check_assembler();
+
+      std::pair<char const*, memory_t> const mixes[] = {
+         {"add/mul", synthetic_loop("      add   [acc], 3, [acc]\n      mul   [acc], 1, [tmp]\n", 8)},
+         {"compare+jump", synthetic_loop("      le    [count], 0, [tmp]\n      jnz   [tmp], done\n", 8)},
+         {"relbase", synthetic_loop("      bso   base+1\n      add   [base+0], 1, [base+0]\n      bso   base-1\n", 8)},
+      };
+
+      for (auto const& [name, mix] : mixes)
+      {
+         auto expected = run_synthetic(program_t{ mix }, l_switch, 100000);
+
+         measure(std::string("synthetic ") + name + ", switch dispatch", 10, expected, [&]() {return run_synthetic(program_t{ mix }, l_switch, 100000); });
+#if INTCODE_THREADED_DISPATCH
+         measure(std::string("synthetic ") + name + ", threaded dispatch", 10, expected, [&]() {return run_synthetic(program_t{ mix }, l_threaded, 100000); });
+#endif
+         measure(std::string("synthetic ") + name + ", jit", 10, expected, [&]() {return run_synthetic(jit_program_t{ mix }, l_execute, 100000); });
+      }
+
+      auto const patched = self_modifying_loop();
+      auto const expected = run_synthetic(program_t{ patched }, l_switch, 100000);
+      measure("self-modifying loop, switch dispatch", 10, expected, [&]() {return run_synthetic(program_t{ patched }, l_switch, 100000); });
+      measure("self-modifying loop, jit", 10, expected, [&]() {return run_synthetic(jit_program_t{ patched }, l_execute, 100000); });
+   }
+
+   // copy-on-write forks
+   {
+      check_fork_sharing(boost, 1000);
+      check_fork_sharing(boost, 10000);
+   }
+
+   // sparse memory
+   {
+      check_sparse_memory();
+   }
+
+   // binary images
+   {
+      check_program_image("..\\data\\aoc2019_09_input1.txt", boost, run_boost(program_t{ boost }, l_execute));
+   }
+
+   // counted loops
+   {
+      check_counted_loops();
+
+      auto const delay = synthetic_loop("      add   [acc], 3, [acc]\n", 1);
+      measure("delay loop, one step at a time", 10, memory_unit{ 300000 }, [&]() {
+         program_t program{ delay };
+         memory_unit result = 0;
+         auto fin = []() {return memory_unit{ 100000 }; };
+         auto fout = [&result](memory_unit const value) {result = value; return false; };
+         while (!program.step(fin, fout)) {}
+         return result; });
+      measure("delay loop, closed form", 10, memory_unit{ 300000 }, [&]() {return run_synthetic(program_t{ delay }, l_execute, 100000); });
+   }
+
+   // instruction budgets
+   {
+      check_budget(boost);
+      check_jit(boost);
+
+      memory_t expected;
+      program_t{ boost }.run(memory_t{ 2 }, expected);
+      measure("day 09 BOOST, run", 50, expected, [&]() {
+         program_t program{ boost };
+         memory_t output;
+         program.run(memory_t{ 2 }, output);
+         return output; });
+      measure("day 09 BOOST, slices of 1000", 50, expected, [&]() {
+         program_t program{ boost };
+         return run_sliced(program, memory_t{ 2 }, 1000); });
+   }
+
+   // checkpoints at the first input
+   {
+      check_checkpoint();
+
+      program_t const droid{ load_program("..\\data\\aoc2019_21_input1.txt") };
+      checkpoint_t const start{ droid };
+      std::cout << "day 21 checkpoint: " << start.skipped() << " instructions, "
+         << start.prefix_output().size() << " outputs before the first IN\n";
+
+      memory_t expected;
+      droid.fork().run(walk_script, expected);
+      measure("day 21 walk, from the start", 20, expected, [&]() {
+         memory_t output;
+         droid.fork().run(walk_script, output);
+         return output; });
+      measure("day 21 walk, from the checkpoint", 20, expected, [&]() {
+         memory_t output;
+         start.run(walk_script, output);
+         return output; });
+
+      program_t const setup{ setup_program(100000) };
+      checkpoint_t const after_setup{ setup };
+      memory_t const values{ 1, 2, 3, 0 };
+      memory_t const expected_values{ 7, 300000, 300000, 600000, 900000 };
+      measure("100000 setup loops, from the start", 20, expected_values, [&]() {
+         memory_t output;
+         setup.fork().run(values, output);
+         return output; });
+      measure("100000 setup loops, from the checkpoint", 20, expected_values, [&]() {
+         memory_t output;
+         after_setup.run(values, output);
+         return output; });
+   }
+
+   // recorded inputs
+   {
+      check_trace_replay();
+   }
+
+   // superinstructions
+   {
+      program_t program{ boost };
+      program.execute([]() {return 2; }, [](memory_unit const) {return false; });
+      print_fusions("day 09 BOOST", program);
+
+      program_t probe{ beam };
+      probe.execute([i = 0]() mutable {return i++ == 0 ? 10 : 20; }, [](memory_unit const) {return false; });
+      print_fusions("day 19 beam (10,20)", probe);
+   }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+#include "intcode.h"
+#include "intcode_checkpoint.h"
+
+struct memo_stats_t
+{
+   size_t hits = 0;
+   size_t misses = 0;
+   size_t evictions = 0;
+   size_t uncached = 0;   // misses whose run did not halt, see run_cache_t
+};
+
+// FNV-1a over the values of an input vector
+struct input_hash_t
+{
+   size_t operator()(memory_t const& input) const
+   {
+      uint64_t hash = 14695981039346656037ull;
+      for (memory_unit const value : input)
+      {
+         hash ^= static_cast<uint64_t>(value);
+         hash *= 1099511628211ull;
+      }
+      return static_cast<size_t>(hash);
+   }
+};
+
+// Outputs of runs of a program, remembered by input. This does not find out
+// whether a program is pure, which was the original idea: it makes the
+// runs pure instead, as every run starts from the same checkpoint of the
+// prototype, so no state is carried from one run to the next and a run's
+// output depends on its input alone. This holds only for a run that
+// halts, though: one that stops for more input is a machine the host would
+// go on feeding, so its output is returned but not remembered. At most
+// capacity results are kept; the least recently used one is dropped to
+// make room. Storing a result costs more than a short run, so the cache
+// pays off only when the same inputs come back, which none of the puzzles
+// do (day 19 never asks about a point twice); it stays with intbench,
+// which measures it on a workload that repeats inputs.
+class run_cache_t
+{
+   struct entry_t
+   {
+      memory_t input;
+      memory_t output;
+   };
+
+   using entries_t = std::list<entry_t>;
+
+   checkpoint_t                                                start;
+   size_t                                                      capacity;
+   // most recently used first
+   entries_t                                                   entries;
+   std::unordered_map<memory_t, entries_t::iterator, input_hash_t> index;
+   memory_t                                                    last;
+   memo_stats_t                                                counters;
+
+public:
+   run_cache_t(program_t const& prototype, size_t const capacity = 65536) :
+      start(prototype), capacity(capacity) {}
+
+   // the outputs of a run of the program on input; the reference is valid
+   // until the next call
+   memory_t const& run(memory_t const& input)
+   {
+      if (auto it = index.find(input); it != index.end())
+      {
+         counters.hits++;
+         entries.splice(entries.begin(), entries, it->second);
+         return it->second->output;
+      }
+
+      counters.misses++;
+
+      memory_t output;
+      if (start.run(input, output).status != run_status_t::halted)
+      {
+         counters.uncached++;
+         last = std::move(output);
+         return last;
+      }
+
+      if (capacity == 0)
+      {
+         last = std::move(output);
+         return last;
+      }
+
+      if (entries.size() >= capacity)
+      {
+         index.erase(entries.back().input);
+         entries.pop_back();
+         counters.evictions++;
+      }
+
+      entries.push_front({ input, std::move(output) });
+      index.emplace(input, entries.begin());
+
+      return entries.front().output;
+   }
+
+   memo_stats_t const& stats() const { return counters; }
+
+   size_t size() const { return entries.size(); }
+
+   void clear()
+   {
+      entries.clear();
+      index.clear();
+   }
+};
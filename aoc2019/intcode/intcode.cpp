@@ -0,0 +1,92 @@
+// intcode.cpp : Defines the non-inline parts of the Intcode engine library.
+//
+
+#include <string>
+#include <charconv>
+#include <bit>
+
+#include "intcode.h"
+
+// commas are found 16 bytes at a time with SSE2, which every x86-64
+// target has; elsewhere the scan is scalar
+#ifndef INTCODE_SIMD_PARSE
+#if defined(__SSE2__) || defined(_M_X64)
+#define INTCODE_SIMD_PARSE 1
+#else
+#define INTCODE_SIMD_PARSE 0
+#endif
+#endif
+
+#if INTCODE_SIMD_PARSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+   bool is_space(char const c)
+   {
+      return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+   }
+
+   // the number between first and last, which may be surrounded by whitespace
+   memory_unit parse_value(std::string_view const text, size_t first, size_t last)
+   {
+      while (first < last && is_space(text[first])) ++first;
+      while (last > first && is_space(text[last - 1])) --last;
+
+      memory_unit value = 0;
+      auto [end, ec] = std::from_chars(text.data() + first, text.data() + last, value);
+      if (first == last || ec != std::errc{} || end != text.data() + last)
+         throw std::runtime_error("invalid value at offset " + std::to_string(first));
+
+      return value;
+   }
+
+   // calls f with the offset of every comma, in order
+   template <typename F>
+   void for_each_comma(std::string_view const text, F&& f)
+   {
+      size_t i = 0;
+
+#if INTCODE_SIMD_PARSE
+      __m128i const comma = _mm_set1_epi8(',');
+      for (; i + 16 <= text.size(); i += 16)
+      {
+         __m128i const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(text.data() + i));
+         unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, comma)));
+
+         while (mask != 0)
+         {
+            f(i + std::countr_zero(mask));
+            mask &= mask - 1;
+         }
+      }
+#endif
+
+      for (; i < text.size(); ++i)
+      {
+         if (text[i] == ',') f(i);
+      }
+   }
+}
+
+memory_t read_program(std::string_view text)
+{
+   memory_t memory;
+
+   if (std::all_of(text.begin(), text.end(), is_space))
+      return memory;
+
+   // every value takes a digit and a comma at least, so this is enough
+   // without reading the text a second time
+   memory.reserve((text.size() + 1) / 2);
+
+   size_t start = 0;
+   for_each_comma(text, [&](size_t const comma) {
+      memory.push_back(parse_value(text, start, comma));
+      start = comma + 1; });
+
+   memory.push_back(parse_value(text, start, text.size()));
+
+   return memory;
+}
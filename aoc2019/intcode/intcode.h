@@ -0,0 +1,832 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <string_view>
+#include <span>
+#include <limits>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <assert.h>
+
+#include "intcode_memory.h"
+#include "intcode_trace.h"
+#include "intcode_image.h"
+#include "intcode_profile.h"
+
+// labels-as-values dispatch is a GCC/Clang extension; other compilers
+// (MSVC) only have the switch based loop. execute uses the switch either
+// way: the threaded loop measured no faster on the puzzle inputs (the time
+// goes to memory accesses, not to dispatch), see the intbench output
+#ifndef INTCODE_THREADED_DISPATCH
+#if defined(__GNUC__)
+#define INTCODE_THREADED_DISPATCH 1
+#else
+#define INTCODE_THREADED_DISPATCH 0
+#endif
+#endif
+
+
+constexpr int OP_ADD = 1;
+constexpr int OP_MUL = 2;
+constexpr int OP_IN = 3;
+constexpr int OP_OUT = 4;
+constexpr int OP_JMPNZ = 5;
+constexpr int OP_JMPZ = 6;
+constexpr int OP_LS = 7;
+constexpr int OP_EQ = 8;
+constexpr int OP_BASEOFF = 9;
+constexpr int OP_HALT = 99;
+
+// superinstructions; they only appear in the decoded stream, never in memory
+constexpr int OP_LS_JUMP = 10;
+constexpr int OP_EQ_JUMP = 11;
+constexpr int OP_BASEOFF_JUMP = 12;
+// the jump that closes a loop of additions, see mark_counted_loops
+constexpr int OP_LOOP_JUMP = 13;
+
+constexpr int MOD_POSITION = 0;
+constexpr int MOD_IMMEDIATE = 1;
+constexpr int MOD_RELBASE = 2;
+
+// an instruction with its opcode and parameter modes already split out;
+// opcode 0 marks a cell that is not decoded (data, or code that was overwritten)
+struct decoded_t
+{
+   uint8_t  opcode = 0;
+   uint8_t  mod1 = 0;
+   uint8_t  mod2 = 0;
+   uint8_t  mod3 = 0;
+   uint32_t next = 0;
+};
+
+using decoded_stream_t = std::vector<decoded_t>;
+
+constexpr int instruction_length(int const opcode)
+{
+   switch (opcode)
+   {
+   case OP_ADD:
+   case OP_MUL:
+   case OP_LS:
+   case OP_EQ:       return 4;
+   case OP_JMPNZ:
+   case OP_JMPZ:     return 3;
+   case OP_IN:
+   case OP_OUT:
+   case OP_BASEOFF:  return 2;
+   case OP_HALT:     return 1;
+   default:          return 0;
+   }
+}
+
+// the instruction a superinstruction starts with
+constexpr int base_opcode(int const opcode)
+{
+   switch (opcode)
+   {
+   case OP_LS_JUMP:        return OP_LS;
+   case OP_EQ_JUMP:        return OP_EQ;
+   case OP_BASEOFF_JUMP:   return OP_BASEOFF;
+   case OP_LOOP_JUMP:      return OP_JMPNZ;
+   default:                return opcode;
+   }
+}
+
+inline decoded_t decode_instruction(memory_unit inst, offset_t const ip)
+{
+   decoded_t op;
+
+   int opcode = inst % 100;
+   if (inst < 0 || instruction_length(opcode) == 0)
+      return op;
+
+   inst /= 100;
+   op.opcode = static_cast<uint8_t>(opcode);
+   op.mod1 = inst % 10; inst /= 10;
+   op.mod2 = inst % 10; inst /= 10;
+   op.mod3 = inst % 10; inst /= 10;
+   op.next = static_cast<uint32_t>(ip + instruction_length(opcode));
+
+   return op;
+}
+
+// marks the pairs that run as one superinstruction: a comparison whose
+// result is tested by the following jump, and a relative base adjustment
+// followed by a jump (the return sequence of compiled code). the jump keeps
+// its own entry and is executed from it, so the pair stays correct if
+// either half is overwritten later. memory is a memory_t or a program_image_t
+template <typename Memory>
+void fuse_instructions(Memory const& memory, decoded_stream_t& decoded)
+{
+   for (size_t ip = 0; ip < decoded.size(); ++ip)
+   {
+      decoded_t& op = decoded[ip];
+      if (op.opcode == 0 || op.next >= decoded.size()) continue;
+
+      decoded_t const& jump = decoded[op.next];
+      if (jump.opcode != OP_JMPNZ && jump.opcode != OP_JMPZ) continue;
+
+      switch (op.opcode)
+      {
+      case OP_LS:
+      case OP_EQ:
+         if (op.mod3 == jump.mod1 && memory[ip + 3] == memory[op.next + 1])
+            op.opcode = op.opcode == OP_LS ? OP_LS_JUMP : OP_EQ_JUMP;
+         break;
+      case OP_BASEOFF:
+         op.opcode = OP_BASEOFF_JUMP;
+         break;
+      }
+   }
+}
+
+// loops with longer bodies are left to the interpreter
+constexpr int MAX_LOOP_BODY = 16;
+
+// marks the jumps that close a loop made of nothing but additions: a jnz
+// with an immediate target before it, and only add instructions from the
+// target up to the jump. whether such a loop is counted, and can be run in
+// closed form, depends on its operands; program_t::accelerate_loop finds
+// that out when the loop runs
+template <typename Memory>
+void mark_counted_loops(Memory const& memory, decoded_stream_t& decoded)
+{
+   for (size_t ip = 0; ip + 2 < decoded.size(); ++ip)
+   {
+      decoded_t& jump = decoded[ip];
+      if (jump.opcode != OP_JMPNZ || jump.mod1 == MOD_IMMEDIATE || jump.mod2 != MOD_IMMEDIATE) continue;
+
+      memory_unit const target = memory[ip + 2];
+      if (target < 0 || static_cast<size_t>(target) >= ip) continue;
+
+      size_t at = static_cast<size_t>(target);
+      int count = 0;
+      while (at < ip && count < MAX_LOOP_BODY && decoded[at].opcode == OP_ADD)
+      {
+         at = decoded[at].next;
+         count++;
+      }
+
+      if (at == ip)
+         jump.opcode = OP_LOOP_JUMP;
+   }
+}
+
+// linear sweep over the program image; cells that do not hold a valid
+// instruction are left undecoded and are decoded on demand if executed
+template <typename Memory>
+decoded_stream_t decode_program(Memory const& memory)
+{
+   decoded_stream_t decoded(memory.size());
+
+   size_t ip = 0;
+   while (ip < memory.size())
+   {
+      decoded[ip] = decode_instruction(memory[ip], ip);
+      ip = decoded[ip].opcode != 0 ? decoded[ip].next : ip + 1;
+   }
+
+   fuse_instructions(memory, decoded);
+   mark_counted_loops(memory, decoded);
+
+   return decoded;
+}
+
+enum class run_status_t { needs_input, halted, output_full, budget_spent };
+
+struct run_result_t
+{
+   run_status_t status;
+   size_t       consumed;
+};
+
+// one past the highest cell that a position mode operand of the decoded
+// program addresses, so that memory can be sized before the program runs
+template <typename Memory>
+size_t static_extent(Memory const& memory, decoded_stream_t const& decoded)
+{
+   size_t extent = memory.size();
+
+   for (size_t ip = 0; ip < decoded.size(); ++ip)
+   {
+      decoded_t const& op = decoded[ip];
+      int const modes[] = { op.mod1, op.mod2, op.mod3 };
+
+      for (int k = 1; k < instruction_length(base_opcode(op.opcode)) && ip + k < memory.size(); ++k)
+      {
+         memory_unit const target = memory[ip + k];
+         if (modes[k - 1] == MOD_POSITION && target >= 0 && static_cast<size_t>(target) < MEMORY_DENSE_PAGES * MEMORY_PAGE_CELLS)
+            extent = std::max(extent, static_cast<size_t>(target) + 1);
+      }
+   }
+
+   return extent;
+}
+
+// how many times each superinstruction was executed
+struct fusion_counters_t
+{
+   size_t less_jump = 0;
+   size_t equal_jump = 0;
+   size_t baseoff_jump = 0;
+   size_t counted_loops = 0;     // loops finished in closed form
+   size_t loop_iterations = 0;   // the iterations that were not interpreted
+};
+
+class program_t
+{
+   friend class jit_program_t;
+
+   static constexpr uint64_t NO_LIMIT = std::numeric_limits<uint64_t>::max();
+
+   std::shared_ptr<decoded_stream_t> decoded;
+   paged_memory_t                    memory;
+   offset_t                          ip = 0;
+   offset_t                          rel_base = 0;
+   bool                              halted = false;
+   fusion_counters_t                 fusions;
+   uint64_t                          executed = 0;
+   // the dispatch loops stop before an instruction once executed reaches it
+   uint64_t                          limit = NO_LIMIT;
+   trace_writer_t*                   tracer = nullptr;
+   profile_t*                        profile = nullptr;
+   // the last decoded instruction a write cleared, for jit_program_t
+   offset_t                          invalidated = -1;
+
+private:
+   memory_unit read_memory(offset_t const off)
+   {
+      return memory.read(off);
+   }
+
+   void write_memory(offset_t const off, memory_unit const value)
+   {
+      memory.write(off, value);
+
+      if (static_cast<size_t>(off) < decoded->size() && (*decoded)[off].opcode != 0)
+         invalidate(off);
+   }
+
+   // the decoded stream is shared between copies of a program until one of
+   // them overwrites a decoded cell. a stream found to be the last copy may
+   // have been read by the other copies on other threads; the acquire fence
+   // (use_count is a relaxed load) orders those reads before the write
+   void invalidate(offset_t const off)
+   {
+      if (decoded.use_count() > 1)
+         decoded = std::make_shared<decoded_stream_t>(*decoded);
+      else
+         std::atomic_thread_fence(std::memory_order_acquire);
+
+      (*decoded)[off].opcode = 0;
+      invalidated = off;
+   }
+
+   decoded_t decode(offset_t const ip)
+   {
+      if (static_cast<size_t>(ip) < decoded->size() && (*decoded)[ip].opcode != 0)
+         return (*decoded)[ip];
+
+      decoded_t op = decode_instruction(read_memory(ip), ip);
+      if (op.opcode == 0)
+         throw std::runtime_error("invalid opcode");
+
+      if (static_cast<size_t>(ip) < decoded->size() && decoded.use_count() == 1)
+      {
+         std::atomic_thread_fence(std::memory_order_acquire);
+         (*decoded)[ip] = op;
+      }
+
+      return op;
+   }
+
+   // counts the instruction about to execute at ip; an IN is taken back by
+   // input_blocked if it cannot run yet
+   void count_instruction()
+   {
+      executed++;
+   }
+
+   memory_unit read_value(offset_t const ip, offset_t const rel_base, int const mode)
+   {
+      offset_t off = -1;
+
+      switch (mode)
+      {
+      case MOD_POSITION:  off = read_memory(ip);            break;
+      case MOD_IMMEDIATE: off = ip;                         break;
+      case MOD_RELBASE:   off = rel_base + read_memory(ip); break;
+      default:            throw std::runtime_error("invalid access mode");
+      }
+
+      return read_memory(off);
+   }
+
+   void write_value(offset_t const ip, offset_t const rel_base, int const mode, memory_unit const value)
+   {
+      offset_t off = -1;
+
+      switch (mode)
+      {
+      case MOD_POSITION:  off = read_memory(ip);            break;
+      case MOD_IMMEDIATE: throw std::runtime_error("cannot write in immediate mode");
+      case MOD_RELBASE:   off = rel_base + read_memory(ip); break;
+      default:            throw std::runtime_error("invalid access mode");
+      }
+
+      write_memory(off, value);
+   }
+
+public:
+   program_t(memory_t const& mem) :
+      decoded(std::make_shared<decoded_stream_t>(decode_program(mem))), memory(mem, static_extent(mem, *decoded)) {}
+
+   program_t(std::initializer_list<memory_unit> mem) : program_t(memory_t(mem)) {}
+
+   // the memory starts out as the pages of the mapped image
+   program_t(program_image_t const& image) :
+      decoded(std::make_shared<decoded_stream_t>(decode_program(image))), memory(image.to_paged_memory(static_extent(image, *decoded))) {}
+
+   // resumes a program whose state was captured elsewhere
+   program_t(memory_t const& mem, offset_t const ip, offset_t const rel_base) :
+      decoded(std::make_shared<decoded_stream_t>(decode_program(mem))), memory(mem, static_extent(mem, *decoded)), ip(ip), rel_base(rel_base) {}
+
+   // copies share memory pages until either side writes to them, so
+   // forking a machine costs one pointer per page
+   program_t fork() const { return *this; }
+
+   using input_t = std::function<memory_unit(void)>;
+   using output_t = std::function<bool(memory_unit)>;
+
+   // runs until the program halts or fout returns true; fin is called as
+   // memory_unit() and fout as bool(memory_unit). the handlers are template
+   // parameters so that lambdas are inlined into the dispatch loop
+   template <typename Input, typename Output>
+   void execute(Input&& fin, Output&& fout)
+   {
+      if (profile != nullptr)
+      {
+         execute_profiled(fin, fout);
+         return;
+      }
+
+      execute_switch(fin, fout);
+   }
+
+   // type-erased overload, for handlers that are stored or passed around
+   void execute(input_t const& fin, output_t const& fout)
+   {
+      execute<input_t const&, output_t const&>(fin, fout);
+   }
+
+   template <typename Input, typename Output>
+   void execute_switch(Input& fin, Output& fout)
+   {
+      while (!halted && executed < limit)
+      {
+         decoded_t const op = decode(ip);
+         count_instruction();
+
+         switch (op.opcode)
+         {
+         case OP_ADD:      execute_add(op); break;
+         case OP_MUL:      execute_mul(op); break;
+         case OP_IN:       if (input_blocked(fin)) return; execute_in(op, fin()); break;
+         case OP_OUT:      if (fout(execute_out(op))) return; break;
+         case OP_JMPNZ:    execute_jump_nz(op); break;
+         case OP_JMPZ:     execute_jump_z(op); break;
+         case OP_LS:       execute_less(op); break;
+         case OP_EQ:       execute_equal(op); break;
+         case OP_BASEOFF:  execute_baseoff(op); break;
+         case OP_LS_JUMP:  fusions.less_jump++; execute_less(op); execute_fused_jump(); break;
+         case OP_EQ_JUMP:  fusions.equal_jump++; execute_equal(op); execute_fused_jump(); break;
+         case OP_BASEOFF_JUMP: fusions.baseoff_jump++; execute_baseoff(op); execute_fused_jump(); break;
+         case OP_LOOP_JUMP: execute_loop_jump(op); break;
+         case OP_HALT:     halted = true; break;
+         }
+      }
+   }
+
+#if INTCODE_THREADED_DISPATCH
+   // every handler ends with its own indirect jump to the next handler,
+   // so the branch predictor sees one dispatch site per opcode; kept to be
+   // measured against execute_switch
+   template <typename Input, typename Output>
+   void execute_threaded(Input& fin, Output& fout)
+   {
+      static void* const handlers[] =
+      {
+         &&op_invalid, &&op_add, &&op_mul, &&op_in, &&op_out,
+         &&op_jmpnz, &&op_jmpz, &&op_ls, &&op_eq, &&op_baseoff,
+         &&op_ls_jump, &&op_eq_jump, &&op_baseoff_jump, &&op_loop_jump, &&op_halt
+      };
+
+      decoded_t op;
+
+#define INTCODE_DISPATCH() \
+      if (executed >= limit) return; \
+      op = decode(ip); \
+      count_instruction(); \
+      goto *handlers[op.opcode == OP_HALT ? 14 : op.opcode]
+
+      if (halted) return;
+      INTCODE_DISPATCH();
+
+   op_add:     execute_add(op); INTCODE_DISPATCH();
+   op_mul:     execute_mul(op); INTCODE_DISPATCH();
+   op_in:      if (input_blocked(fin)) return; execute_in(op, fin()); INTCODE_DISPATCH();
+   op_out:     if (fout(execute_out(op))) return; INTCODE_DISPATCH();
+   op_jmpnz:   execute_jump_nz(op); INTCODE_DISPATCH();
+   op_jmpz:    execute_jump_z(op); INTCODE_DISPATCH();
+   op_ls:      execute_less(op); INTCODE_DISPATCH();
+   op_eq:      execute_equal(op); INTCODE_DISPATCH();
+   op_baseoff: execute_baseoff(op); INTCODE_DISPATCH();
+   op_ls_jump: fusions.less_jump++; execute_less(op); execute_fused_jump(); INTCODE_DISPATCH();
+   op_eq_jump: fusions.equal_jump++; execute_equal(op); execute_fused_jump(); INTCODE_DISPATCH();
+   op_baseoff_jump: fusions.baseoff_jump++; execute_baseoff(op); execute_fused_jump(); INTCODE_DISPATCH();
+   op_loop_jump: execute_loop_jump(op); INTCODE_DISPATCH();
+   op_halt:    halted = true; return;
+   op_invalid: throw std::runtime_error("invalid opcode");
+
+#undef INTCODE_DISPATCH
+   }
+#endif
+
+   // one instruction at a time, so that the dispatch loops do not pay for
+   // the profile when there is none
+   template <typename Input, typename Output>
+   void execute_profiled(Input& fin, Output& fout)
+   {
+      while (!halted && executed < limit)
+      {
+         offset_t const at = ip;
+         uint64_t const before = executed;
+         decoded_t const op = decode(ip);
+
+         bool const stop = step(fin, fout);
+         // an IN that blocked was not executed
+         if (executed != before)
+            profile->count(at, base_opcode(op.opcode), op.mod1, op.mod2, op.mod3);
+
+         if (stop) return;
+      }
+   }
+
+   // executes a single instruction (the first half of a superinstruction);
+   // returns true if the program halted, is blocked on input or fout asked to stop
+   template <typename Input, typename Output>
+   bool step(Input& fin, Output& fout)
+   {
+      if (halted) return true;
+
+      decoded_t const op = decode(ip);
+      count_instruction();
+
+      switch (base_opcode(op.opcode))
+      {
+      case OP_ADD:      execute_add(op); break;
+      case OP_MUL:      execute_mul(op); break;
+      case OP_IN:       if (input_blocked(fin)) return true; execute_in(op, fin()); break;
+      case OP_OUT:      return fout(execute_out(op));
+      case OP_JMPNZ:    execute_jump_nz(op); break;
+      case OP_JMPZ:     execute_jump_z(op); break;
+      case OP_LS:       execute_less(op); break;
+      case OP_EQ:       execute_equal(op); break;
+      case OP_BASEOFF:  execute_baseoff(op); break;
+      case OP_HALT:     halted = true; return true;
+      }
+
+      return false;
+   }
+
+   // runs as execute does, but stops before the next instruction once
+   // budget more instructions have been executed (a superinstruction can
+   // take it one over); returns true if it stopped for the budget. the
+   // machine carries on from there the next time it is run, so a scheduler
+   // can time-slice machines, or give up on one that spends too much
+   template <typename Input, typename Output>
+   bool execute_for(uint64_t const budget, Input&& fin, Output&& fout)
+   {
+      struct restore_t
+      {
+         uint64_t& limit;
+         ~restore_t() { limit = NO_LIMIT; }
+      } restore{ limit };
+
+      limit = budget < NO_LIMIT - executed ? executed + budget : NO_LIMIT;
+      execute(fin, fout);
+
+      return !halted && executed >= limit;
+   }
+
+   // runs until the program halts, needs more input than it was given, or
+   // output holds max_output values; inputs are taken from the front of the
+   // span and the result says how many were consumed
+   run_result_t run(std::span<memory_unit const> input, memory_t& output,
+                    size_t const max_output = std::numeric_limits<size_t>::max())
+   {
+      return run_for(NO_LIMIT, input, output, max_output);
+   }
+
+   // as run, but it also stops with run_status_t::budget_spent once budget
+   // more instructions have been executed, as execute_for does
+   run_result_t run_for(uint64_t const budget, std::span<memory_unit const> input, memory_t& output,
+                        size_t const max_output = std::numeric_limits<size_t>::max())
+   {
+      if (halted) return { run_status_t::halted, 0 };
+      if (output.size() >= max_output) return { run_status_t::output_full, 0 };
+
+      span_input_t fin{ input };
+      auto fout = [&output, max_output](memory_unit const value) {
+         output.push_back(value);
+         return output.size() >= max_output; };
+
+      bool const spent = execute_for(budget, fin, fout);
+
+      if (halted) return { run_status_t::halted, fin.consumed };
+      if (output.size() >= max_output) return { run_status_t::output_full, fin.consumed };
+      if (spent) return { run_status_t::budget_spent, fin.consumed };
+      return { run_status_t::needs_input, fin.consumed };
+   }
+
+   bool is_halted() const { return halted; }
+
+   offset_t get_ip() const { return ip; }
+
+   offset_t get_rel_base() const { return rel_base; }
+
+   paged_memory_t const& get_memory() const { return memory; }
+
+   fusion_counters_t const& fusion_counters() const { return fusions; }
+
+   // instructions executed by the interpreter, superinstructions counting
+   // as two; copies and forks carry the count on
+   uint64_t instructions() const { return executed; }
+
+   // records every input the program consumes from now on into target,
+   // until it is set to null
+   void set_trace(trace_writer_t* const target) { tracer = target; }
+
+   // counts every instruction execute runs from now on into target, until
+   // it is set to null; forks count into the same profile. a profiled
+   // program runs one instruction at a time, with no counted loops
+   void set_profile(profile_t* const target) { profile = target; }
+
+   void reset() { ip = 0; rel_base = 0; halted = false; }
+
+   // continues from another point, for a machine whose memory was set up
+   // with write to the state it had elsewhere
+   void resume_at(offset_t const at, offset_t const base) { ip = at; rel_base = base; halted = false; }
+
+   memory_unit read(offset_t const off) { return read_memory(off); }
+
+   void write(offset_t const off, memory_unit const value) { write_memory(off, value); }
+
+private:
+   // input handlers may have a ready() member; the loops stop in front of
+   // an IN, without executing it, when it returns false
+   template <typename Input>
+   static bool is_blocked(Input& fin)
+   {
+      if constexpr (requires { fin.ready(); })
+         return !fin.ready();
+      else
+         return false;
+   }
+
+   template <typename Input>
+   bool input_blocked(Input& fin)
+   {
+      if (!is_blocked(fin)) return false;
+
+      executed--;
+      return true;
+   }
+
+   struct span_input_t
+   {
+      std::span<memory_unit const> values;
+      size_t                       consumed = 0;
+
+      bool ready() const { return consumed < values.size(); }
+
+      memory_unit operator()() { return values[consumed++]; }
+   };
+
+   void execute_add(decoded_t const& op)
+   {
+      assert(op.mod3 != MOD_IMMEDIATE);
+      memory_unit param1 = read_value(ip + 1, rel_base, op.mod1);
+      memory_unit param2 = read_value(ip + 2, rel_base, op.mod2);
+      write_value(ip + 3, rel_base, op.mod3, param1 + param2);
+      ip = op.next;
+   }
+
+   void execute_mul(decoded_t const& op)
+   {
+      assert(op.mod3 != MOD_IMMEDIATE);
+      memory_unit param1 = read_value(ip + 1, rel_base, op.mod1);
+      memory_unit param2 = read_value(ip + 2, rel_base, op.mod2);
+      write_value(ip + 3, rel_base, op.mod3, param1 * param2);
+      ip = op.next;
+   }
+
+   void execute_in(decoded_t const& op, memory_unit const input)
+   {
+      assert(op.mod1 != MOD_IMMEDIATE);
+      if (tracer != nullptr)
+         tracer->record(executed - 1, input);
+      write_value(ip + 1, rel_base, op.mod1, input);
+      ip = op.next;
+   }
+
+   memory_unit execute_out(decoded_t const& op)
+   {
+      memory_unit param = read_value(ip + 1, rel_base, op.mod1);
+      ip = op.next;
+      return param;
+   }
+
+   void execute_jump_nz(decoded_t const& op)
+   {
+      memory_unit param1 = read_value(ip + 1, rel_base, op.mod1);
+      if (param1 != 0)
+         ip = read_value(ip + 2, rel_base, op.mod2);
+      else
+         ip = op.next;
+   }
+
+   void execute_jump_z(decoded_t const& op)
+   {
+      memory_unit param1 = read_value(ip + 1, rel_base, op.mod1);
+      if (param1 == 0)
+         ip = read_value(ip + 2, rel_base, op.mod2);
+      else
+         ip = op.next;
+   }
+
+   void execute_less(decoded_t const& op)
+   {
+      memory_unit param1 = read_value(ip + 1, rel_base, op.mod1);
+      memory_unit param2 = read_value(ip + 2, rel_base, op.mod2);
+      write_value(ip + 3, rel_base, op.mod3, param1 < param2 ? 1 : 0);
+      ip = op.next;
+   }
+
+   void execute_equal(decoded_t const& op)
+   {
+      memory_unit param1 = read_value(ip + 1, rel_base, op.mod1);
+      memory_unit param2 = read_value(ip + 2, rel_base, op.mod2);
+      write_value(ip + 3, rel_base, op.mod3, param1 == param2 ? 1 : 0);
+      ip = op.next;
+   }
+
+   void execute_baseoff(decoded_t const& op)
+   {
+      memory_unit param1 = read_value(ip + 1, rel_base, op.mod1);
+      rel_base += param1;
+      ip = op.next;
+   }
+
+   // second half of a superinstruction; if the jump was overwritten in the
+   // meantime, whatever is there now is left to the dispatch loop
+   void execute_fused_jump()
+   {
+      decoded_t const jump = (*decoded)[ip];
+      if (jump.opcode != 0)
+         count_instruction();
+
+      if (base_opcode(jump.opcode) == OP_JMPNZ)
+         execute_jump_nz(jump);
+      else if (jump.opcode == OP_JMPZ)
+         execute_jump_z(jump);
+   }
+
+   offset_t operand_address(offset_t const at, int const mode)
+   {
+      return mode == MOD_RELBASE ? rel_base + read_memory(at) : read_memory(at);
+   }
+
+   void execute_loop_jump(decoded_t const& op)
+   {
+      offset_t const jump = ip;
+      execute_jump_nz(op);
+
+      if (ip != op.next)
+         accelerate_loop(jump, op);
+   }
+
+   // A loop marked by mark_counted_loops has just run an iteration and is
+   // about to run another. If every add of its body is cell += k, with k a
+   // constant or a cell the body does not write, and the jump tests a cell
+   // that the body steps by s, the loop runs n more times where x + n * s
+   // reaches 0 for the current value x of that cell; all the cells are
+   // then updated by n times their step at once. Anything else (a body that
+   // writes a cell it reads or the code of the loop, a counter that never
+   // reaches 0) is left to the interpreter. The instruction count is kept
+   // as if the loop had been interpreted, and stays within the budget.
+   void accelerate_loop(offset_t const jump, decoded_t const& op)
+   {
+      struct update_t
+      {
+         offset_t    cell;
+         memory_unit step;
+      };
+
+      std::array<update_t, MAX_LOOP_BODY> updates;
+      std::array<offset_t, 2 * MAX_LOOP_BODY> sources;
+      size_t source_count = 0;
+      size_t count = 0;
+
+      offset_t const start = ip;
+      offset_t at = start;
+      while (at < jump)
+      {
+         decoded_t const add = decode(at);
+         if (add.opcode != OP_ADD || count == MAX_LOOP_BODY) return;
+
+         offset_t const cell = operand_address(at + 3, add.mod3);
+         memory_unit step = 0;
+         int self = 0;
+
+         for (int k = 1; k <= 2; ++k)
+         {
+            int const mode = k == 1 ? add.mod1 : add.mod2;
+            if (mode == MOD_IMMEDIATE)
+            {
+               step = read_memory(at + k);
+               continue;
+            }
+
+            offset_t const source = operand_address(at + k, mode);
+            if (source == cell)
+            {
+               self++;
+               continue;
+            }
+
+            step = read_memory(source);
+            sources[source_count++] = source;
+         }
+
+         if (self != 1) return;
+
+         updates[count++] = { cell, step };
+         at = add.next;
+      }
+
+      if (at != jump) return;
+
+      offset_t const counter = operand_address(jump + 1, op.mod1);
+      memory_unit stride = 0;
+
+      for (size_t i = 0; i < count; ++i)
+      {
+         offset_t const cell = updates[i].cell;
+         if (cell >= start && cell < jump + 3) return;
+         if (std::find(sources.begin(), sources.begin() + source_count, cell) != sources.begin() + source_count) return;
+
+         if (cell == counter)
+            stride = static_cast<memory_unit>(static_cast<uint64_t>(stride) + static_cast<uint64_t>(updates[i].step));
+      }
+
+      memory_unit const x = read_memory(counter);
+      if (stride == 0 || x == std::numeric_limits<memory_unit>::min() || x % stride != 0 || x / stride >= 0) return;
+
+      // no more iterations than the budget leaves room for; if that is not
+      // all of them, the loop goes on from its start
+      uint64_t const per_iteration = count + 1;
+      uint64_t const room = (limit - executed) / per_iteration;
+      uint64_t n = static_cast<uint64_t>(-(x / stride));
+      bool const finished = n <= room;
+      if (!finished) n = room;
+      if (n == 0) return;
+
+      // the additions wrap like the interpreted ones
+      for (size_t i = 0; i < count; ++i)
+      {
+         uint64_t const value = static_cast<uint64_t>(read_memory(updates[i].cell)) + n * static_cast<uint64_t>(updates[i].step);
+         write_memory(updates[i].cell, static_cast<memory_unit>(value));
+      }
+
+      executed += n * per_iteration;
+      fusions.loop_iterations += n;
+
+      if (finished)
+      {
+         fusions.counted_loops++;
+         ip = op.next;
+      }
+   }
+};
+
+// comma separated values, with any whitespace around them; text that holds
+// nothing but whitespace is an empty program. anything else is reported as
+// a runtime_error with its offset
+memory_t read_program(std::string_view text);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <optional>
+
+#include "intcode.h"
+
+// Base for the programs translated to C++ by intaot. The translated code
+// treats the instructions it reached, and the operands no instruction
+// writes to, as constants; a write into one of those guarded cells, or a
+// jump to an address that was not translated, hands the rest of the run to
+// the interpreter.
+class aot_program_t
+{
+protected:
+   memory_t                 memory;
+   offset_t                 ip = 0;
+   offset_t                 rel_base = 0;
+   bool                     halted = false;
+   uint8_t const*           guarded = nullptr;
+   size_t                   guarded_size = 0;
+   std::optional<program_t> fallback;
+
+   aot_program_t(memory_t const& image, size_t const size, uint8_t const* guard, size_t const guard_size) :
+      memory(image), guarded(guard), guarded_size(guard_size)
+   {
+      // every constant address of the translated code is within this size
+      if (memory.size() < size)
+         memory.resize(size, 0);
+   }
+
+   memory_unit load(offset_t const off)
+   {
+      if (off < 0) throw std::runtime_error("index out of bounds");
+
+      if (static_cast<size_t>(off) >= memory.size())
+         memory.resize(off + 1, 0);
+
+      return memory[off];
+   }
+
+   // returns true if the write invalidated the translated code
+   bool store(offset_t const off, memory_unit const value)
+   {
+      if (off < 0) throw std::runtime_error("index out of bounds");
+
+      if (static_cast<size_t>(off) >= memory.size())
+         memory.resize(off + 1, 0);
+
+      memory[off] = value;
+
+      return static_cast<size_t>(off) < guarded_size && guarded[off] != 0;
+   }
+
+   void interpret(program_t::input_t const& fin, program_t::output_t const& fout)
+   {
+      if (!fallback)
+         fallback.emplace(memory, ip, rel_base);
+
+      fallback->execute(fin, fout);
+   }
+
+public:
+   bool is_halted() const { return fallback ? fallback->is_halted() : halted; }
+
+   bool is_translated() const { return !fallback; }
+
+   memory_unit read(offset_t const off) { return fallback ? fallback->read(off) : load(off); }
+
+   void write(offset_t const off, memory_unit const value)
+   {
+      if (fallback)
+         fallback->write(off, value);
+      else if (store(off, value))
+         fallback.emplace(memory, ip, rel_base);
+   }
+};
@@ -0,0 +1,311 @@
+// intcode_asm.cpp : Assembler for the Intcode mnemonics of the intcomp disassembler.
+//
+
+#include <string>
+#include <vector>
+#include <map>
+#include <charconv>
+#include <cctype>
+
+#include "intcode_asm.h"
+
+namespace
+{
+   // label, optionally negated, plus a constant
+   struct expression_t
+   {
+      std::string symbol;
+      bool        negate = false;
+      memory_unit offset = 0;
+   };
+
+   struct operand_t
+   {
+      int          mode = MOD_IMMEDIATE;
+      expression_t value;
+   };
+
+   // opcode 0 is a data directive
+   struct statement_t
+   {
+      size_t                 line = 0;
+      int                    opcode = 0;
+      std::vector<operand_t> operands;
+   };
+
+   std::map<std::string_view, int> const mnemonics{ {"add", OP_ADD}, {"mul", OP_MUL}, {"in", OP_IN}, {"out", OP_OUT}, {"jnz", OP_JMPNZ}, {"jz", OP_JMPZ}, {"le", OP_LS}, {"eq", OP_EQ}, {"bso", OP_BASEOFF}, {"hlt", OP_HALT} };
+
+   [[noreturn]] void error(size_t const line, std::string_view message)
+   {
+      throw std::runtime_error("line " + std::to_string(line) + ": " + std::string(message));
+   }
+
+   std::string_view trim(std::string_view text)
+   {
+      while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+      while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+      return text;
+   }
+
+   bool is_identifier(std::string_view text)
+   {
+      if (text.empty() || std::isdigit(static_cast<unsigned char>(text.front()))) return false;
+
+      return std::all_of(text.begin(), text.end(), [](char const c) {
+         return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.'; });
+   }
+
+   // base, base+value, base-value or base0
+   bool is_base(std::string_view text)
+   {
+      if (text.substr(0, 4) != "base") return false;
+      if (text.size() == 4) return true;
+
+      unsigned char const next = text[4];
+      return !std::isalpha(next) && next != '_' && next != '.';
+   }
+
+   // the address column the disassembler prints before every statement: at
+   // least four hex digits, which no mnemonic or label is
+   bool is_address(std::string_view text)
+   {
+      return text.size() >= 4 && std::all_of(text.begin(), text.end(), [](char const c) {
+         return std::isxdigit(static_cast<unsigned char>(c)) != 0; });
+   }
+
+   memory_unit parse_number(std::string_view text, size_t const line)
+   {
+      text = trim(text);
+      if (!text.empty() && text.front() == '+') text.remove_prefix(1);
+
+      memory_unit value = 0;
+      auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+      if (ec != std::errc{} || end != text.data() + text.size() || text.empty())
+         error(line, "invalid number '" + std::string(text) + "'");
+
+      return value;
+   }
+
+   expression_t parse_expression(std::string_view text, size_t const line)
+   {
+      expression_t value;
+
+      text = trim(text);
+      if (text.empty()) error(line, "missing operand");
+
+      // a number, including its sign
+      if (std::isdigit(static_cast<unsigned char>(text.front())) ||
+         ((text.front() == '-' || text.front() == '+') && text.size() > 1 && std::isdigit(static_cast<unsigned char>(text[1]))))
+      {
+         value.offset = parse_number(text, line);
+         return value;
+      }
+
+      if (text.front() == '-')
+      {
+         value.negate = true;
+         text = trim(text.substr(1));
+      }
+
+      size_t const split = text.find_first_of("+-");
+      value.symbol = std::string(trim(text.substr(0, split)));
+      if (!is_identifier(value.symbol) || value.symbol == "base")
+         error(line, "invalid label '" + value.symbol + "'");
+
+      if (split != std::string_view::npos)
+      {
+         value.offset = parse_number(text.substr(split + 1), line);
+         if (text[split] == '-') value.offset = -value.offset;
+      }
+
+      return value;
+   }
+
+   // the value after base in base+value, base-value or base0
+   expression_t parse_base_offset(std::string_view text, size_t const line)
+   {
+      text = trim(text);
+      if (text.empty()) return {};
+      if (text.front() == '+') text.remove_prefix(1);
+      return parse_expression(text, line);
+   }
+
+   operand_t parse_operand(std::string_view text, size_t const line)
+   {
+      operand_t operand;
+
+      text = trim(text);
+      if (text.empty()) error(line, "missing operand");
+
+      if (text.front() != '[')
+      {
+         operand.value = parse_expression(text, line);
+         return operand;
+      }
+
+      if (text.back() != ']') error(line, "missing ]");
+
+      text = trim(text.substr(1, text.size() - 2));
+      if (is_base(text))
+      {
+         operand.mode = MOD_RELBASE;
+         operand.value = parse_base_offset(text.substr(4), line);
+      }
+      else
+      {
+         operand.mode = MOD_POSITION;
+         operand.value = parse_expression(text, line);
+      }
+
+      return operand;
+   }
+
+   std::vector<std::string_view> split_operands(std::string_view text)
+   {
+      std::vector<std::string_view> parts;
+
+      text = trim(text);
+      if (text.empty()) return parts;
+
+      size_t start = 0;
+      size_t end = text.find(',');
+      while (end != std::string_view::npos)
+      {
+         parts.push_back(text.substr(start, end - start));
+         start = end + 1;
+         end = text.find(',', start);
+      }
+      parts.push_back(text.substr(start));
+
+      return parts;
+   }
+
+   statement_t parse_statement(std::string_view mnemonic, std::string_view text, size_t const line)
+   {
+      statement_t statement;
+      statement.line = line;
+
+      auto const operands = split_operands(text);
+
+      if (mnemonic == "data")
+      {
+         if (operands.empty()) error(line, "data without values");
+
+         for (auto const operand : operands)
+            statement.operands.push_back({ MOD_IMMEDIATE, parse_expression(operand, line) });
+
+         return statement;
+      }
+
+      auto it = mnemonics.find(mnemonic);
+      if (it == mnemonics.end()) error(line, "unknown mnemonic '" + std::string(mnemonic) + "'");
+
+      statement.opcode = it->second;
+      if (operands.size() != static_cast<size_t>(instruction_length(statement.opcode) - 1))
+         error(line, "wrong number of operands for " + std::string(mnemonic));
+
+      for (auto const operand : operands)
+      {
+         // bso base+value adjusts the base by an immediate value
+         std::string_view const trimmed = trim(operand);
+         if (statement.opcode == OP_BASEOFF && is_base(trimmed))
+            statement.operands.push_back({ MOD_IMMEDIATE, parse_base_offset(trimmed.substr(4), line) });
+         else
+            statement.operands.push_back(parse_operand(operand, line));
+      }
+
+      // the operand written to cannot be immediate
+      int const written = statement.opcode == OP_IN ? 0 :
+         (statement.opcode == OP_ADD || statement.opcode == OP_MUL || statement.opcode == OP_LS || statement.opcode == OP_EQ) ? 2 : -1;
+      if (written >= 0 && statement.operands[written].mode == MOD_IMMEDIATE)
+         error(line, "immediate operand cannot be written");
+
+      return statement;
+   }
+
+   size_t statement_size(statement_t const& statement)
+   {
+      return statement.opcode == 0 ? statement.operands.size() : instruction_length(statement.opcode);
+   }
+}
+
+memory_t assemble(std::string_view source)
+{
+   std::vector<statement_t> statements;
+   std::map<std::string, memory_unit> labels;
+   size_t address = 0;
+
+   size_t line = 0;
+   while (!source.empty())
+   {
+      ++line;
+
+      size_t const end = source.find('\n');
+      std::string_view text = source.substr(0, end);
+      source = end == std::string_view::npos ? std::string_view{} : source.substr(end + 1);
+
+      text = trim(text.substr(0, text.find(';')));
+
+      // the address column of disassembler output is skipped
+      size_t const column = text.find_first_of(" \t");
+      if (column != std::string_view::npos && is_address(text.substr(0, column)))
+         text = trim(text.substr(column));
+
+      // labels
+      size_t colon = text.find(':');
+      while (colon != std::string_view::npos && is_identifier(trim(text.substr(0, colon))))
+      {
+         std::string const label(trim(text.substr(0, colon)));
+         if (label == "base") error(line, "base is not a label");
+         if (!labels.emplace(label, static_cast<memory_unit>(address)).second)
+            error(line, "duplicate label '" + label + "'");
+
+         text = trim(text.substr(colon + 1));
+         colon = text.find(':');
+      }
+
+      if (text.empty()) continue;
+
+      size_t const space = std::min(text.size(), text.find_first_of(" \t"));
+      statements.push_back(parse_statement(text.substr(0, space), text.substr(space), line));
+      address += statement_size(statements.back());
+   }
+
+   memory_t memory;
+   memory.reserve(address);
+
+   for (auto const& statement : statements)
+   {
+      std::vector<memory_unit> values;
+      for (auto const& operand : statement.operands)
+      {
+         memory_unit value = operand.value.offset;
+         if (!operand.value.symbol.empty())
+         {
+            auto it = labels.find(operand.value.symbol);
+            if (it == labels.end()) error(statement.line, "undefined label '" + operand.value.symbol + "'");
+            value += operand.value.negate ? -it->second : it->second;
+         }
+         values.push_back(value);
+      }
+
+      if (statement.opcode == 0)
+      {
+         memory.insert(memory.end(), values.begin(), values.end());
+         continue;
+      }
+
+      memory_unit inst = statement.opcode;
+      memory_unit scale = 100;
+      for (auto const& operand : statement.operands)
+      {
+         inst += operand.mode * scale;
+         scale *= 10;
+      }
+
+      memory.push_back(inst);
+      memory.insert(memory.end(), values.begin(), values.end());
+   }
+
+   return memory;
+}
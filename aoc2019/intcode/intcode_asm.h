@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string_view>
+
+#include "intcode.h"
+
+// Assembles the mnemonics printed by the intcomp disassembler into a
+// program image. One statement per line, optionally preceded by labels:
+//
+//    loop:  add   [base+1], -1, [base+1]   ; comments run to the end of the line
+//           jnz   [base+1], loop
+//           bso   base-2
+//    table: data  1, 2, loop, end+1
+//
+// Operands are immediate (a value), positional ([value]) or relative to
+// the base ([base+value]); a value is a number, a label or a label plus or
+// minus a number. bso takes its operand as base+value as well as in any of
+// the other forms. A line may start with the hex address the disassembler
+// prints, which is ignored, so that its output assembles back into the same
+// program. Errors are reported as runtime_error with the line.
+memory_t assemble(std::string_view source);
@@ -0,0 +1,439 @@
+// intcode_batch.cpp : Lockstep execution of a batch of Intcode machines.
+//
+
+#include <array>
+#include <span>
+#include <bit>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#if INTCODE_BATCH_AVX2 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "intcode_batch.h"
+#include "intcode_batch_avx2.h"
+
+#if INTCODE_BATCH_AVX2
+bool cpu_has_avx2()
+{
+#if defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7) return false;
+
+   // AVX, and the ymm registers enabled by the system
+   __cpuid(info, 1);
+   if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+      return false;
+
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+#else
+   return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+namespace
+{
+   using lanes_t = std::array<memory_unit, BATCH_LANES>;
+   using mask_t = uint32_t;
+
+   static_assert(BATCH_LANES <= 32 && BATCH_LANES % 4 == 0);
+   static_assert(std::is_same_v<memory_unit, long long>);
+
+   // cells a lockstep group keeps for each lane; lanes addressing past them
+   // continue on program_t, whose paged memory handles any address
+   constexpr size_t BATCH_MAX_CELLS = size_t{ 1 } << 16;
+
+   // result[l] = a[l] op b[l] for an arithmetic or comparison opcode
+   template <int Opcode>
+   void combine(lanes_t const& a, lanes_t const& b, lanes_t& result, [[maybe_unused]] bool const avx2)
+   {
+#if INTCODE_BATCH_AVX2
+      // AVX2 has no 64 bit multiplication, mul stays on the loop
+      if (avx2 && Opcode != OP_MUL)
+      {
+         if constexpr (Opcode == OP_ADD)
+            add_lanes_avx2(a.data(), b.data(), result.data(), BATCH_LANES);
+         else if constexpr (Opcode == OP_LS)
+            less_lanes_avx2(a.data(), b.data(), result.data(), BATCH_LANES);
+         else if constexpr (Opcode == OP_EQ)
+            equal_lanes_avx2(a.data(), b.data(), result.data(), BATCH_LANES);
+         return;
+      }
+#endif
+
+      for (size_t l = 0; l < BATCH_LANES; ++l)
+      {
+         if constexpr (Opcode == OP_ADD)
+            result[l] = a[l] + b[l];
+         else if constexpr (Opcode == OP_MUL)
+            result[l] = a[l] * b[l];
+         else if constexpr (Opcode == OP_LS)
+            result[l] = a[l] < b[l] ? 1 : 0;
+         else
+            result[l] = a[l] == b[l] ? 1 : 0;
+      }
+   }
+
+   bool is_uniform(lanes_t const& values)
+   {
+      memory_unit different = 0;
+      for (size_t l = 1; l < BATCH_LANES; ++l)
+         different |= values[l] ^ values[0];
+      return different == 0;
+   }
+
+   // up to BATCH_LANES machines sharing one instruction pointer. the cells
+   // of lanes that left the group are not kept up to date: loads and stores
+   // work on every lane, with the addresses of the lanes that left replaced
+   // by one of an active lane
+   class lockstep_t
+   {
+      program_t const&                prototype;
+      memory_t const&                 image;
+      std::span<memory_t const>       inputs;
+      std::span<memory_t>             outputs;
+      batch_stats_t&                  stats;
+      bool                            avx2;
+
+      // cell a of lane l is at a * BATCH_LANES + l
+      std::vector<memory_unit>        cells;
+      size_t                          extent = 0;
+      offset_t                        ip = 0;
+      lanes_t                         rel_base{};
+      std::array<size_t, BATCH_LANES> consumed{};
+      mask_t                          active = 0;
+      // all ones in the active lanes, zero in the others
+      lanes_t                         live{};
+
+   public:
+      lockstep_t(program_t const& prototype, memory_t const& image, std::vector<memory_unit> const& cells,
+                 std::span<memory_t const> inputs, std::span<memory_t> outputs, batch_stats_t& stats, bool const avx2) :
+         prototype(prototype), image(image), inputs(inputs), outputs(outputs), stats(stats), avx2(avx2),
+         cells(cells), extent(cells.size() / BATCH_LANES)
+      {
+         set_active(static_cast<mask_t>((uint64_t{ 1 } << inputs.size()) - 1));
+      }
+
+      void run()
+      {
+         while (active != 0)
+            step();
+      }
+
+   private:
+      memory_unit* row(size_t const off) { return cells.data() + off * BATCH_LANES; }
+
+      size_t first_lane() const { return static_cast<size_t>(std::countr_zero(active)); }
+
+      void set_active(mask_t const lanes)
+      {
+         active = lanes;
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+            live[l] = (active >> l & 1) != 0 ? -1 : 0;
+      }
+
+      // the lanes where values differ from value, among the active ones
+      mask_t differing(lanes_t const& values, memory_unit const value) const
+      {
+         mask_t lanes = 0;
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+            lanes |= static_cast<mask_t>(((values[l] ^ value) & live[l]) != 0) << l;
+         return lanes;
+      }
+
+      // makes room for cells below end; false if that is more than a group keeps
+      bool reserve(size_t const end)
+      {
+         if (end <= extent) return true;
+         if (end > BATCH_MAX_CELLS) return false;
+
+         extent = std::min(BATCH_MAX_CELLS, std::max(end, extent * 2));
+         cells.resize(extent * BATCH_LANES, 0);
+         return true;
+      }
+
+      // hands the lanes over to forks of the prototype, each at its own
+      // instruction and with the cells it changed, and lets them finish
+      // their runs
+      void peel(mask_t const lanes, lanes_t const& at)
+      {
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+         {
+            if ((lanes >> l & 1) == 0) continue;
+
+            program_t program = prototype.fork();
+            for (size_t off = 0; off < extent; ++off)
+            {
+               memory_unit const value = cells[off * BATCH_LANES + l];
+               if (value != (off < image.size() ? image[off] : 0))
+                  program.write(static_cast<offset_t>(off), value);
+            }
+
+            program.resume_at(static_cast<offset_t>(at[l]), static_cast<offset_t>(rel_base[l]));
+            program.run(std::span<memory_unit const>(inputs[l]).subspan(consumed[l]), outputs[l]);
+
+            stats.peeled++;
+         }
+
+         set_active(active & ~lanes);
+      }
+
+      void peel(mask_t const lanes)
+      {
+         lanes_t at;
+         at.fill(ip);
+         peel(lanes, at);
+      }
+
+      // the cells operand k addresses in every lane. the active lanes that
+      // address a cell outside the group's memory are peeled off, and the
+      // others go on; false if that leaves none, or if the mode is invalid
+      // (all of them are peeled off, and program_t reports it)
+      bool address(int const mode, int const k, lanes_t& addresses)
+      {
+         if (mode != MOD_POSITION && mode != MOD_RELBASE)
+         {
+            peel(active);
+            return false;
+         }
+
+         memory_unit const* const operand = row(ip + k);
+
+         // a negative address is a large unsigned one
+         mask_t outside = 0;
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+         {
+            memory_unit const off = operand[l] + (mode == MOD_RELBASE ? rel_base[l] : 0);
+            if ((active >> l & 1) != 0 && static_cast<uint64_t>(off) >= BATCH_MAX_CELLS)
+               outside |= mask_t{ 1 } << l;
+         }
+
+         if (outside != 0)
+         {
+            peel(outside);
+            if (active == 0) return false;
+         }
+
+         memory_unit const shared = operand[first_lane()] + (mode == MOD_RELBASE ? rel_base[first_lane()] : 0);
+
+         uint64_t high = 0;
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+         {
+            memory_unit const off = operand[l] + (mode == MOD_RELBASE ? rel_base[l] : 0);
+            addresses[l] = (off & live[l]) | (shared & ~live[l]);
+            high = std::max(high, static_cast<uint64_t>(addresses[l]));
+         }
+
+         reserve(static_cast<size_t>(high) + 1);
+         return true;
+      }
+
+      bool load(int const mode, int const k, lanes_t& values)
+      {
+         if (mode == MOD_IMMEDIATE)
+         {
+            std::copy_n(row(ip + k), BATCH_LANES, values.begin());
+            return true;
+         }
+
+         lanes_t addresses;
+         if (!address(mode, k, addresses))
+            return false;
+
+         if (is_uniform(addresses))
+            std::copy_n(row(addresses[0]), BATCH_LANES, values.begin());
+         else
+         {
+            for (size_t l = 0; l < BATCH_LANES; ++l)
+               values[l] = cells[addresses[l] * BATCH_LANES + l];
+         }
+
+         return true;
+      }
+
+      void store(lanes_t const& addresses, lanes_t const& values)
+      {
+         if (is_uniform(addresses))
+            std::copy_n(values.begin(), BATCH_LANES, row(addresses[0]));
+         else
+         {
+            for (size_t l = 0; l < BATCH_LANES; ++l)
+               cells[addresses[l] * BATCH_LANES + l] = values[l];
+         }
+      }
+
+      template <int Opcode>
+      void execute_binary(decoded_t const& op)
+      {
+         lanes_t a, b, addresses;
+         if (!load(op.mod1, 1, a) || !load(op.mod2, 2, b) || !address(op.mod3, 3, addresses))
+            return;
+
+         lanes_t result;
+         combine<Opcode>(a, b, result, avx2);
+         store(addresses, result);
+         ip = op.next;
+      }
+
+      // every lane that has no input left leaves the group first
+      void execute_in(decoded_t const& op)
+      {
+         mask_t starved = 0;
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+            if ((active >> l & 1) != 0 && consumed[l] >= inputs[l].size()) starved |= mask_t{ 1 } << l;
+
+         if (starved != 0) peel(starved);
+         if (active == 0) return;
+
+         lanes_t addresses;
+         if (!address(op.mod1, 1, addresses))
+            return;
+
+         lanes_t values{};
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+            if ((active >> l & 1) != 0) values[l] = inputs[l][consumed[l]++];
+
+         store(addresses, values);
+         ip = op.next;
+      }
+
+      void execute_out(decoded_t const& op)
+      {
+         lanes_t values;
+         if (!load(op.mod1, 1, values))
+            return;
+
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+            if ((active >> l & 1) != 0) outputs[l].push_back(values[l]);
+
+         ip = op.next;
+      }
+
+      // the largest group of lanes going to the same instruction goes on,
+      // the others are peeled off at their own target
+      void execute_jump(decoded_t const& op, bool const if_zero)
+      {
+         lanes_t condition, target;
+         if (!load(op.mod1, 1, condition) || !load(op.mod2, 2, target))
+            return;
+
+         lanes_t next;
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+            next[l] = (condition[l] == 0) == if_zero ? target[l] : static_cast<memory_unit>(op.next);
+
+         mask_t best = active & ~differing(next, next[first_lane()]);
+         if (best != active)
+         {
+            for (size_t l = 0; l < BATCH_LANES; ++l)
+            {
+               mask_t const group = active & ~differing(next, next[l]);
+               if ((active >> l & 1) != 0 && std::popcount(group) > std::popcount(best))
+                  best = group;
+            }
+
+            peel(active & ~best, next);
+         }
+
+         ip = static_cast<offset_t>(next[first_lane()]);
+      }
+
+      void execute_baseoff(decoded_t const& op)
+      {
+         lanes_t values;
+         if (!load(op.mod1, 1, values))
+            return;
+
+         for (size_t l = 0; l < BATCH_LANES; ++l)
+            rel_base[l] += values[l];
+
+         ip = op.next;
+      }
+
+      void step()
+      {
+         if (ip < 0 || !reserve(static_cast<size_t>(ip) + 4))
+         {
+            peel(active);
+            return;
+         }
+
+         // lanes that overwrote the instruction with something else leave
+         lanes_t code;
+         std::copy_n(row(ip), BATCH_LANES, code.begin());
+         memory_unit const inst = code[first_lane()];
+
+         mask_t const different = differing(code, inst);
+         if (different != 0)
+         {
+            peel(different);
+            if (active == 0) return;
+         }
+
+         decoded_t const op = decode_instruction(inst, ip);
+         if (op.opcode == 0)
+         {
+            peel(active);
+            return;
+         }
+
+         stats.steps++;
+         stats.lane_instructions += std::popcount(active);
+
+         switch (op.opcode)
+         {
+         case OP_ADD:      execute_binary<OP_ADD>(op); break;
+         case OP_MUL:      execute_binary<OP_MUL>(op); break;
+         case OP_IN:       execute_in(op); break;
+         case OP_OUT:      execute_out(op); break;
+         case OP_JMPNZ:    execute_jump(op, false); break;
+         case OP_JMPZ:     execute_jump(op, true); break;
+         case OP_LS:       execute_binary<OP_LS>(op); break;
+         case OP_EQ:       execute_binary<OP_EQ>(op); break;
+         case OP_BASEOFF:  execute_baseoff(op); break;
+         case OP_HALT:     set_active(0); break;
+         }
+      }
+   };
+}
+
+std::vector<memory_t> run_batch(memory_t const& memory, std::vector<memory_t> const& inputs, batch_stats_t& stats)
+{
+   std::vector<memory_t> outputs(inputs.size());
+
+   // the program in every lane, and decoded once for the machines peeled off
+   std::vector<memory_unit> cells(memory.size() * BATCH_LANES);
+   for (size_t off = 0; off < memory.size(); ++off)
+      std::fill_n(cells.begin() + off * BATCH_LANES, BATCH_LANES, memory[off]);
+
+   program_t const prototype{ memory };
+
+#if INTCODE_BATCH_AVX2
+   static bool const avx2 = cpu_has_avx2();
+#else
+   bool const avx2 = false;
+#endif
+   stats.vectorized = avx2;
+
+   for (size_t first = 0; first < inputs.size(); first += BATCH_LANES)
+   {
+      size_t const count = std::min(BATCH_LANES, inputs.size() - first);
+
+      lockstep_t group{ prototype, memory, cells, std::span(inputs).subspan(first, count), std::span(outputs).subspan(first, count), stats, avx2 };
+      group.run();
+   }
+
+   stats.machines += inputs.size();
+
+   return outputs;
+}
+
+std::vector<memory_t> run_batch(memory_t const& memory, std::vector<memory_t> const& inputs)
+{
+   batch_stats_t stats;
+   return run_batch(memory, inputs, stats);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "intcode.h"
+
+// machines run side by side by run_batch
+constexpr size_t BATCH_LANES = 8;
+
+struct batch_stats_t
+{
+   size_t machines = 0;
+   size_t steps = 0;               // instructions executed in lockstep, once for all lanes
+   size_t lane_instructions = 0;   // the same, counted once per lane that took part
+   size_t peeled = 0;              // machines finished on program_t after leaving lockstep
+   bool   vectorized = false;      // add, less than and equals were combined with AVX2
+};
+
+// Runs the program once per input set, as program_t::run would, and returns
+// the outputs of every run. Machines are taken BATCH_LANES at a time and
+// execute in lockstep while their instruction pointers agree: memory is
+// laid out cell by cell with the lanes of a cell side by side, so a cell
+// every lane addresses at the same position is loaded or stored as one
+// block. Of the instructions, only add, less than and equals combine the
+// lanes with AVX2 (when the processor has it), through out-of-line calls
+// to intcode_batch_avx2.cpp; mul (AVX2 has no 64 bit multiplication), the
+// jump conditions and the addressing are plain loops over the lanes. When
+// a jump sends lanes to different places, the largest group carries on and
+// the others are peeled off into a program_t each, which finishes their
+// run on its own. A lane also leaves for program_t when it runs out of
+// input or addresses a cell past the first 65536, the most a group keeps
+// for each lane; the other lanes stay.
+std::vector<memory_t> run_batch(memory_t const& memory, std::vector<memory_t> const& inputs, batch_stats_t& stats);
+
+std::vector<memory_t> run_batch(memory_t const& memory, std::vector<memory_t> const& inputs);
@@ -0,0 +1,44 @@
+// intcode_batch_avx2.cpp : AVX2 lane arithmetic for the lockstep batch.
+//
+// built with /arch:AVX2 (see intcode.vcxproj), or with the target pragma
+// below on gcc and clang, whatever the rest of the library targets
+
+#include <cstddef>
+
+#include "intcode_batch_avx2.h"
+
+#if INTCODE_BATCH_AVX2
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+
+namespace
+{
+   __m256i load(long long const* p) { return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p)); }
+
+   void store(long long* p, __m256i const value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), value); }
+}
+
+void add_lanes_avx2(long long const* a, long long const* b, long long* result, size_t const count)
+{
+   for (size_t l = 0; l < count; l += 4)
+      store(result + l, _mm256_add_epi64(load(a + l), load(b + l)));
+}
+
+// the comparisons give all ones where true, shifted down to 1
+void less_lanes_avx2(long long const* a, long long const* b, long long* result, size_t const count)
+{
+   for (size_t l = 0; l < count; l += 4)
+      store(result + l, _mm256_srli_epi64(_mm256_cmpgt_epi64(load(b + l), load(a + l)), 63));
+}
+
+void equal_lanes_avx2(long long const* a, long long const* b, long long* result, size_t const count)
+{
+   for (size_t l = 0; l < count; l += 4)
+      store(result + l, _mm256_srli_epi64(_mm256_cmpeq_epi64(load(a + l), load(b + l)), 63));
+}
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+// the lane arithmetic of run_batch has an AVX2 version on x86, used when
+// the processor running it supports AVX2 (see cpu_has_avx2); defined to 0,
+// the lanes are always combined by plain loops
+#ifndef INTCODE_BATCH_AVX2
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define INTCODE_BATCH_AVX2 1
+#else
+#define INTCODE_BATCH_AVX2 0
+#endif
+#endif
+
+#if INTCODE_BATCH_AVX2
+// result[l] = a[l] op b[l] for the count lanes, a multiple of 4. these are
+// built for AVX2 in a translation unit of their own that includes nothing
+// else of the engine, so that no code shared with the rest is compiled for
+// AVX2; they may only be called when cpu_has_avx2 is true
+void add_lanes_avx2(long long const* a, long long const* b, long long* result, size_t count);
+void less_lanes_avx2(long long const* a, long long const* b, long long* result, size_t count);
+void equal_lanes_avx2(long long const* a, long long const* b, long long* result, size_t count);
+
+// true if the processor has AVX2 and the system saves its registers
+bool cpu_has_avx2();
+#endif
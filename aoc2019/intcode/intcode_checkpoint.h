@@ -0,0 +1,47 @@
+#pragma once
+
+#include <span>
+#include <limits>
+
+#include "intcode.h"
+
+// A program run from its start up to the first IN, so that runs which all
+// begin the same way resume from there instead of replaying the setup.
+// Nothing before the first IN depends on input, so the state of the
+// machine and the outputs it has made at that point are the same for every
+// run. A program that neither reads input nor halts never gets there, and
+// neither does the constructor.
+class checkpoint_t
+{
+   program_t origin;
+   program_t machine;
+   memory_t  prefix;
+
+public:
+   explicit checkpoint_t(program_t const& prototype) : origin(prototype.fork()), machine(prototype.fork())
+   {
+      machine.run({}, prefix);
+   }
+
+   // a machine at the checkpoint; it has made the outputs in prefix_output
+   program_t start() const { return machine.fork(); }
+
+   // the outputs made before the first IN
+   memory_t const& prefix_output() const { return prefix; }
+
+   // instructions executed before the first IN, which runs from the
+   // checkpoint do not execute again
+   uint64_t skipped() const { return machine.instructions() - origin.instructions(); }
+
+   // what program_t::run would do on a fresh machine, prefix output included
+   run_result_t run(std::span<memory_unit const> input, memory_t& output,
+                    size_t const max_output = std::numeric_limits<size_t>::max()) const
+   {
+      // a run that would stop on an output before the checkpoint
+      if (output.size() + prefix.size() >= max_output && !prefix.empty())
+         return origin.fork().run(input, output, max_output);
+
+      output.insert(output.end(), prefix.begin(), prefix.end());
+      return machine.fork().run(input, output, max_output);
+   }
+};
@@ -0,0 +1,37 @@
+// intcode_coroutine.cpp : Intcode machines run as coroutines.
+//
+
+#include "intcode.h"
+#include "intcode_coroutine.h"
+
+machine_coroutine_t run_machine(program_t program)
+{
+   auto& promise = co_await machine_coroutine_t::promise_ref_t{};
+   memory_t output;
+
+   while (true)
+   {
+      // the engine stops at every output, at an IN that has nothing left to
+      // read, and when the budget of this resume is spent
+      output.clear();
+      auto const result = program.run_for(promise.budget, promise.pending(), output, 1);
+      promise.consume(result.consumed);
+
+      switch (result.status)
+      {
+      case run_status_t::halted:
+         co_return;
+      case run_status_t::output_full:
+         co_yield output.front();
+         break;
+      case run_status_t::needs_input:
+         promise.state = machine_state_t::needs_input;
+         co_await std::suspend_always{};
+         break;
+      case run_status_t::budget_spent:
+         promise.state = machine_state_t::preempted;
+         co_await std::suspend_always{};
+         break;
+      }
+   }
+}
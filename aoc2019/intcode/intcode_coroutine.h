@@ -0,0 +1,153 @@
+#pragma once
+
+#include <coroutine>
+#include <span>
+#include <exception>
+#include <utility>
+#include <limits>
+
+#include "intcode.h"
+
+enum class machine_state_t { output, needs_input, halted, preempted };
+
+// An Intcode machine run as a C++20 coroutine, so that any number of them
+// can be multiplexed on one thread with no threads, locks or context
+// switches: a suspended machine is its coroutine frame and nothing else.
+// Inputs are queued with send. resume runs the machine until an OUT, which
+// yields the value (read it with output), until an IN finds no input that
+// has been sent, which suspends the machine until it is resumed again, or
+// until it halts. Given a budget, resume also returns once the machine has
+// executed that many instructions, in machine_state_t::preempted; it goes
+// on from there when it is next resumed, so a machine that spins without
+// reading input cannot keep the others from running. An exception thrown
+// by the engine halts the machine and is rethrown by resume.
+class machine_coroutine_t
+{
+public:
+   struct promise_type
+   {
+      memory_t             inbox;
+      size_t               consumed = 0;
+      memory_unit          value = 0;
+      machine_state_t      state = machine_state_t::needs_input;
+      uint64_t             budget = std::numeric_limits<uint64_t>::max();
+      std::exception_ptr   error;
+
+      machine_coroutine_t get_return_object()
+      {
+         return machine_coroutine_t{ std::coroutine_handle<promise_type>::from_promise(*this) };
+      }
+
+      // the machine does not run until it is first resumed, so that it can
+      // be sent its first inputs
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      std::suspend_always final_suspend() noexcept { return {}; }
+
+      std::suspend_always yield_value(memory_unit const output)
+      {
+         value = output;
+         state = machine_state_t::output;
+         return {};
+      }
+
+      void return_void() { state = machine_state_t::halted; }
+
+      void unhandled_exception()
+      {
+         error = std::current_exception();
+         state = machine_state_t::halted;
+      }
+
+      // the inputs sent and not yet read
+      std::span<memory_unit const> pending() const
+      {
+         return std::span<memory_unit const>(inbox).subspan(consumed);
+      }
+
+      void consume(size_t const count)
+      {
+         consumed += count;
+         if (consumed == inbox.size())
+         {
+            inbox.clear();
+            consumed = 0;
+         }
+      }
+   };
+
+   // lets the body of the coroutine reach its promise, without suspending
+   struct promise_ref_t
+   {
+      promise_type* promise = nullptr;
+
+      bool await_ready() const noexcept { return false; }
+
+      bool await_suspend(std::coroutine_handle<promise_type> const handle) noexcept
+      {
+         promise = &handle.promise();
+         return false;
+      }
+
+      promise_type& await_resume() const noexcept { return *promise; }
+   };
+
+private:
+   std::coroutine_handle<promise_type> handle;
+
+   explicit machine_coroutine_t(std::coroutine_handle<promise_type> const handle) : handle(handle) {}
+
+public:
+   machine_coroutine_t(machine_coroutine_t&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+   machine_coroutine_t& operator=(machine_coroutine_t&& other) noexcept
+   {
+      if (this != &other)
+      {
+         if (handle) handle.destroy();
+         handle = std::exchange(other.handle, nullptr);
+      }
+      return *this;
+   }
+
+   machine_coroutine_t(machine_coroutine_t const&) = delete;
+   machine_coroutine_t& operator=(machine_coroutine_t const&) = delete;
+
+   ~machine_coroutine_t()
+   {
+      if (handle) handle.destroy();
+   }
+
+   void send(memory_unit const value) { handle.promise().inbox.push_back(value); }
+
+   void send(std::span<memory_unit const> values)
+   {
+      auto& inbox = handle.promise().inbox;
+      inbox.insert(inbox.end(), values.begin(), values.end());
+   }
+
+   // budget is the most instructions the machine may execute before it is
+   // preempted
+   machine_state_t resume(uint64_t const budget = std::numeric_limits<uint64_t>::max())
+   {
+      if (handle.done()) return machine_state_t::halted;
+
+      handle.promise().budget = budget;
+      handle.resume();
+
+      if (auto& error = handle.promise().error; error != nullptr)
+         std::rethrow_exception(std::exchange(error, nullptr));
+
+      return handle.promise().state;
+   }
+
+   // the value of the last OUT, after resume returned machine_state_t::output
+   memory_unit output() const { return handle.promise().value; }
+
+   // inputs sent that the machine has not read yet
+   size_t pending() const { return handle.promise().pending().size(); }
+
+   bool is_halted() const { return handle.done(); }
+};
+
+// the program as a coroutine machine; it owns the program from now on
+machine_coroutine_t run_machine(program_t program);
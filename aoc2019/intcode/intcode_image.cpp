@@ -0,0 +1,212 @@
+// intcode_image.cpp : Binary Intcode program images and their cache.
+//
+
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <thread>
+#include <functional>
+#include <bit>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "intcode.h"
+#include "intcode_image.h"
+
+// cells are stored in the byte order of the host
+static_assert(std::endian::native == std::endian::little, "program images need a little-endian host");
+
+namespace
+{
+   // a private, writable view of the whole file; writes never reach the file
+   std::shared_ptr<void> map_file(std::string const& path, size_t& size)
+   {
+#ifdef _WIN32
+      HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("cannot open " + path);
+
+      LARGE_INTEGER length{};
+      ::GetFileSizeEx(file, &length);
+      size = static_cast<size_t>(length.QuadPart);
+
+      HANDLE mapping = size > 0 ? ::CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr) : nullptr;
+      ::CloseHandle(file);
+      if (mapping == nullptr) throw std::runtime_error("cannot map " + path);
+
+      void* view = ::MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+      ::CloseHandle(mapping);
+      if (view == nullptr) throw std::runtime_error("cannot map " + path);
+
+      return std::shared_ptr<void>(view, [](void* p) { ::UnmapViewOfFile(p); });
+#else
+      int const fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) throw std::runtime_error("cannot open " + path);
+
+      struct stat info {};
+      ::fstat(fd, &info);
+      size = static_cast<size_t>(info.st_size);
+
+      void* view = size > 0 ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+      ::close(fd);
+      if (view == MAP_FAILED) throw std::runtime_error("cannot map " + path);
+
+      return std::shared_ptr<void>(view, [size](void* p) { ::munmap(p, size); });
+#endif
+   }
+
+   uint64_t process_id()
+   {
+#ifdef _WIN32
+      return ::GetCurrentProcessId();
+#else
+      return static_cast<uint64_t>(::getpid());
+#endif
+   }
+
+   size_t pages_for(size_t const cells)
+   {
+      return (cells + MEMORY_PAGE_MASK) >> MEMORY_PAGE_BITS;
+   }
+}
+
+program_image_t::program_image_t(std::string const& path)
+{
+   size_t size = 0;
+   mapping = map_file(path, size);
+
+   image_header_t header;
+   if (size < sizeof(header)) throw std::runtime_error(path + " is not a program image");
+   std::memcpy(&header, mapping.get(), sizeof(header));
+
+   if (std::memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0)
+      throw std::runtime_error(path + " is not a program image");
+   if (header.version != IMAGE_VERSION)
+      throw std::runtime_error(path + " has an unsupported image version");
+   if (header.pages != pages_for(header.cells) || size != IMAGE_HEADER_SIZE + header.pages * sizeof(memory_page_t))
+      throw std::runtime_error(path + " is truncated");
+
+   pages = reinterpret_cast<memory_page_t*>(static_cast<char*>(mapping.get()) + IMAGE_HEADER_SIZE);
+   cells = static_cast<size_t>(header.cells);
+   page_count = static_cast<size_t>(header.pages);
+   hash = header.source_hash;
+   text_size = header.source_size;
+   text_time = header.source_time;
+}
+
+memory_t program_image_t::to_memory() const
+{
+   memory_t memory(cells);
+   for (size_t page = 0; page < page_count; ++page)
+   {
+      size_t const first = page * MEMORY_PAGE_CELLS;
+      std::copy_n(pages[page].cells, std::min(MEMORY_PAGE_CELLS, cells - first), memory.begin() + first);
+   }
+   return memory;
+}
+
+uint64_t hash_source(std::string_view text)
+{
+   uint64_t hash = 14695981039346656037ull;
+   for (char const c : text)
+   {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ull;
+   }
+   return hash;
+}
+
+void write_image(std::string const& path, memory_t const& memory, uint64_t const source_hash,
+                 uint64_t const source_size, int64_t const source_time)
+{
+   std::ofstream output(path, std::ios::binary);
+   if (!output.is_open()) throw std::runtime_error("cannot create " + path);
+
+   image_header_t header{};
+   std::memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+   header.version = IMAGE_VERSION;
+   header.cells = memory.size();
+   header.source_hash = source_hash;
+   header.pages = pages_for(memory.size());
+   header.source_size = source_size;
+   header.source_time = source_time;
+   output.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+   // the shared flag word, then a page of cells
+   uint64_t const flags = 1;
+   memory_unit page[MEMORY_PAGE_CELLS];
+   for (size_t first = 0; first < memory.size(); first += MEMORY_PAGE_CELLS)
+   {
+      size_t const count = std::min(MEMORY_PAGE_CELLS, memory.size() - first);
+      std::fill(std::copy_n(memory.begin() + first, count, page), std::end(page), 0);
+
+      output.write(reinterpret_cast<char const*>(&flags), sizeof(flags));
+      output.write(reinterpret_cast<char const*>(page), sizeof(page));
+   }
+
+   if (!output) throw std::runtime_error("cannot write " + path);
+}
+
+std::string image_cache_dir()
+{
+   return (std::filesystem::temp_directory_path() / "intcode_cache").string();
+}
+
+program_image_t load_cached_program(std::string const& path, std::string const& cache_dir)
+{
+   std::error_code error;
+   uint64_t const size = std::filesystem::file_size(path, error);
+   if (error) throw std::runtime_error("cannot open " + path);
+   int64_t const time = std::filesystem::last_write_time(path).time_since_epoch().count();
+
+   std::string const key = std::filesystem::absolute(path).string() + '\n' + std::to_string(size) + '\n' + std::to_string(time);
+   char name[32];
+   std::snprintf(name, sizeof(name), "%016llx.icim", static_cast<unsigned long long>(hash_source(key)));
+   std::string const image_path = (std::filesystem::path(cache_dir) / name).string();
+
+   try
+   {
+      program_image_t image(image_path);
+      if (image.source_size() == size && image.source_time() == time)
+         return image;
+   }
+   catch (std::runtime_error const&)
+   {
+      // no image yet, or a damaged one: written again
+   }
+
+   std::ifstream input(path, std::ios::binary);
+   if (!input.is_open()) throw std::runtime_error("cannot open " + path);
+
+   std::stringstream buffer;
+   buffer << input.rdbuf();
+   std::string const text = buffer.str();
+
+   // written under a name no other writer uses, then renamed, so that a
+   // concurrent reader never maps a partial image
+   std::filesystem::create_directories(cache_dir);
+   std::string const temporary = image_path + "." + std::to_string(process_id()) + "." +
+      std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+   write_image(temporary, read_program(text), hash_source(text), size, time);
+
+   std::filesystem::rename(temporary, image_path, error);
+   if (error)
+   {
+      // the image is open elsewhere (Windows does not replace it then);
+      // the one there was made from the same file
+      std::filesystem::remove(temporary, error);
+   }
+
+   return program_image_t(image_path);
+}
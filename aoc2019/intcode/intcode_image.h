@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstdint>
+
+#include "intcode_memory.h"
+
+// Binary program images. A 64 byte header (the "ICIM" magic, a version,
+// the number of cells, the hash of the text the image was made from, the
+// number of pages, and the size and modification time of the text file)
+// is followed by the cells in little-endian 64 bit
+// words, one memory page at a time: each page is laid out as a
+// memory_page_t, a word holding its shared flag (set) and then the cells,
+// the last page padded with zeros. A mapped image can therefore be handed
+// to paged_memory_t as is: every page starts out shared, so the first write
+// to one copies it like any other shared page. The file is mapped private
+// and is never changed.
+
+constexpr char     IMAGE_MAGIC[4] = { 'I', 'C', 'I', 'M' };
+constexpr uint32_t IMAGE_VERSION = 1;
+constexpr size_t   IMAGE_HEADER_SIZE = 64;
+
+struct image_header_t
+{
+   char     magic[4];
+   uint32_t version;
+   uint64_t cells;
+   uint64_t source_hash;
+   uint64_t pages;
+   uint64_t source_size;
+   int64_t  source_time;
+   uint64_t reserved[2];
+};
+
+static_assert(sizeof(image_header_t) == IMAGE_HEADER_SIZE);
+
+// a mapped image file; copies share the mapping, which stays alive as long
+// as an image or a memory made from it does
+class program_image_t
+{
+   std::shared_ptr<void> mapping;
+   memory_page_t*        pages = nullptr;
+   size_t                cells = 0;
+   size_t                page_count = 0;
+   uint64_t              hash = 0;
+   uint64_t              text_size = 0;
+   int64_t               text_time = 0;
+
+public:
+   program_image_t() = default;
+
+   // maps the image at path; throws runtime_error if it cannot be opened or is not an image
+   explicit program_image_t(std::string const& path);
+
+   size_t size() const { return cells; }
+
+   uint64_t source_hash() const { return hash; }
+
+   uint64_t source_size() const { return text_size; }
+
+   int64_t source_time() const { return text_time; }
+
+   memory_unit operator[](size_t const off) const
+   {
+      return pages[off >> MEMORY_PAGE_BITS].cells[off & MEMORY_PAGE_MASK];
+   }
+
+   memory_t to_memory() const;
+
+   paged_memory_t to_paged_memory(size_t const reserve = 0) const
+   {
+      return paged_memory_t(pages, page_count, mapping, reserve);
+   }
+};
+
+// FNV-1a of the program text, the key of the image cache
+uint64_t hash_source(std::string_view text);
+
+void write_image(std::string const& path, memory_t const& memory, uint64_t const source_hash = 0,
+                 uint64_t const source_size = 0, int64_t const source_time = 0);
+
+// intcode_cache in the temporary directory of the system, so that cached
+// images stay out of the source tree
+std::string image_cache_dir();
+
+// The program in the text file at path, through an image in cache_dir named
+// after the path, size and modification time of the file. A hit only looks
+// up the file and maps the image; as with make, a text changed without
+// changing its size or time is not noticed. The image is written when the
+// cache has none for the file, under a name of its own first, so that any
+// number of processes and threads can fill the cache at once.
+program_image_t load_cached_program(std::string const& path, std::string const& cache_dir = image_cache_dir());
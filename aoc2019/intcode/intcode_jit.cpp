@@ -0,0 +1,673 @@
+// intcode_jit.cpp : Translates Intcode basic blocks to x86-64 machine code.
+//
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "intcode_jit.h"
+
+// state shared between the host loop and a compiled block; the offsets are
+// baked into the generated code
+struct jit_context_t
+{
+   memory_page_t* const* pages;
+   int64_t          page_count;
+   decoded_t const* decoded;
+   int64_t          decoded_size;
+   int64_t          ip;
+   int64_t          rel_base;
+   int64_t          exit;
+   int64_t          executed;
+};
+
+constexpr int CTX_PAGES = 0;
+constexpr int CTX_PAGE_COUNT = 8;
+constexpr int CTX_DECODED = 16;
+constexpr int CTX_DECODED_SIZE = 24;
+constexpr int CTX_IP = 32;
+constexpr int CTX_REL_BASE = 40;
+constexpr int CTX_EXIT = 48;
+constexpr int CTX_EXECUTED = 56;
+
+static_assert(offsetof(jit_context_t, pages) == CTX_PAGES, "unexpected jit_context_t layout");
+static_assert(offsetof(jit_context_t, page_count) == CTX_PAGE_COUNT, "unexpected jit_context_t layout");
+static_assert(offsetof(jit_context_t, decoded) == CTX_DECODED, "unexpected jit_context_t layout");
+static_assert(offsetof(jit_context_t, decoded_size) == CTX_DECODED_SIZE, "unexpected jit_context_t layout");
+static_assert(offsetof(jit_context_t, ip) == CTX_IP, "unexpected jit_context_t layout");
+static_assert(offsetof(jit_context_t, rel_base) == CTX_REL_BASE, "unexpected jit_context_t layout");
+static_assert(offsetof(jit_context_t, exit) == CTX_EXIT, "unexpected jit_context_t layout");
+static_assert(offsetof(jit_context_t, executed) == CTX_EXECUTED, "unexpected jit_context_t layout");
+static_assert(sizeof(decoded_t) == 8 && offsetof(decoded_t, opcode) == 0, "compiled stores probe decoded_t::opcode");
+
+constexpr int PAGE_SHARED = 0;
+constexpr int PAGE_CELLS = 8;
+
+static_assert(sizeof(std::atomic<bool>) == 1 && offsetof(memory_page_t, shared) == PAGE_SHARED, "compiled stores probe memory_page_t::shared");
+static_assert(offsetof(memory_page_t, cells) == PAGE_CELLS, "unexpected memory_page_t layout");
+
+// the block ran to its end (or took a jump); ip is the next instruction
+constexpr int64_t EXIT_NEXT = 0;
+// the instruction at ip must be executed by the interpreter
+constexpr int64_t EXIT_FALLBACK = 1;
+
+using jit_block_t = void(*)(jit_context_t*);
+
+constexpr size_t CODE_BUFFER_SIZE = 1 << 20;
+constexpr int    MAX_BLOCK_INSTRUCTIONS = 64;
+// the most cells a block can span, four per instruction
+constexpr offset_t MAX_BLOCK_CELLS = 4 * MAX_BLOCK_INSTRUCTIONS;
+// a block overwritten this many times is left to the interpreter
+constexpr int    MAX_BLOCK_DROPS = 4;
+
+// executable memory that is only writable while code is being appended
+class code_buffer_t
+{
+   uint8_t* base = nullptr;
+   size_t   used = 0;
+
+public:
+   code_buffer_t() = default;
+   code_buffer_t(code_buffer_t const&) = delete;
+   code_buffer_t& operator=(code_buffer_t const&) = delete;
+
+   ~code_buffer_t()
+   {
+      if (base == nullptr) return;
+#if defined(_WIN32)
+      VirtualFree(base, 0, MEM_RELEASE);
+#else
+      munmap(base, CODE_BUFFER_SIZE);
+#endif
+   }
+
+   // returns nullptr when the buffer is full
+   void* append(std::vector<uint8_t> const& code)
+   {
+      if (base == nullptr) allocate();
+      if (used + code.size() > CODE_BUFFER_SIZE) return nullptr;
+
+      protect(true);
+      std::memcpy(base + used, code.data(), code.size());
+      protect(false);
+
+      void* start = base + used;
+      used += (code.size() + 15) & ~size_t{ 15 };
+      return start;
+   }
+
+   void clear() { used = 0; }
+
+private:
+   void allocate()
+   {
+#if defined(_WIN32)
+      base = static_cast<uint8_t*>(VirtualAlloc(nullptr, CODE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+      if (base == nullptr) throw std::runtime_error("cannot allocate executable memory");
+#else
+      void* p = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) throw std::runtime_error("cannot allocate executable memory");
+      base = static_cast<uint8_t*>(p);
+#endif
+   }
+
+   void protect(bool const writable)
+   {
+#if defined(_WIN32)
+      DWORD old;
+      VirtualProtect(base, CODE_BUFFER_SIZE, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old);
+      if (!writable) FlushInstructionCache(GetCurrentProcess(), base, CODE_BUFFER_SIZE);
+#else
+      mprotect(base, CODE_BUFFER_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+#endif
+   }
+};
+
+struct jit_cache_t
+{
+   // the decoded stream the blocks were compiled from; a program whose
+   // stream differs (a copy overwrote an instruction of a stream they
+   // shared) needs a new cache. the reference is weak so that it does not
+   // count as a copy: a program that owns its stream overwrites it in
+   // place, and only the blocks over the instruction are dropped
+   std::weak_ptr<decoded_stream_t> owner;
+   std::vector<jit_block_t>        blocks;
+   std::vector<uint8_t>            attempted;
+   // instructions in each block, one past its last cell, and how many
+   // times it was dropped
+   std::vector<uint8_t>            lengths;
+   std::vector<offset_t>           ends;
+   std::vector<uint8_t>            drops;
+   // cells some block may have been compiled over
+   std::vector<uint8_t>            covered;
+   code_buffer_t                   code;
+   size_t                          count = 0;
+
+   jit_cache_t(std::shared_ptr<decoded_stream_t> const& decoded) :
+      owner(decoded), blocks(decoded->size(), nullptr), attempted(decoded->size(), 0),
+      lengths(decoded->size(), 0), ends(decoded->size(), 0), drops(decoded->size(), 0), covered(decoded->size(), 0)
+   {}
+
+   bool compiled_from(std::shared_ptr<decoded_stream_t> const& decoded) const
+   {
+      return !owner.owner_before(decoded) && !decoded.owner_before(owner);
+   }
+
+   void flush()
+   {
+      std::fill(blocks.begin(), blocks.end(), nullptr);
+      std::fill(attempted.begin(), attempted.end(), 0);
+      code.clear();
+      count = 0;
+   }
+
+   // the blocks over the cell are compiled again the next time they are
+   // entered, unless they keep being overwritten; their code stays in the
+   // buffer until it is flushed
+   void drop(offset_t const off)
+   {
+      if (covered[off] == 0) return;
+
+      for (offset_t start = std::max<offset_t>(off - MAX_BLOCK_CELLS + 1, 0); start <= off; ++start)
+      {
+         if (blocks[start] == nullptr || ends[start] <= off) continue;
+
+         blocks[start] = nullptr;
+         if (++drops[start] < MAX_BLOCK_DROPS)
+            attempted[start] = 0;
+         count--;
+      }
+
+      covered[off] = 0;
+   }
+};
+
+#if INTCODE_JIT
+
+enum reg_t : uint8_t
+{
+   RAX = 0, RCX = 1, RDX = 2, RDI = 7, R8 = 8, R9 = 9, R10 = 10, R11 = 11
+};
+
+// condition codes
+constexpr uint8_t CC_AE = 0x3;
+constexpr uint8_t CC_E = 0x4;
+constexpr uint8_t CC_NE = 0x5;
+constexpr uint8_t CC_L = 0xC;
+
+// register allocation inside a block:
+//    r11 = jit_context_t*, r8 = page table, r9 = page count, r10 = relative base,
+//    rax, rcx, rdx = scratch
+// all of them are volatile in both the System V and the Windows x64 ABI
+class assembler_t
+{
+   struct fallback_t
+   {
+      size_t   pos;
+      offset_t ip;
+      int      executed;
+   };
+
+   std::vector<uint8_t>    code;
+   std::vector<fallback_t> fallbacks;
+   // instructions of the block before the one being compiled
+   int                     executed = 0;
+
+public:
+   std::vector<uint8_t> const& bytes() const { return code; }
+
+   // the instruction being compiled is done; an exit from a later one counts it
+   void next_instruction() { executed++; }
+
+   void prologue()
+   {
+#if defined(_WIN32)
+      mov_rr(R11, RCX);
+#else
+      mov_rr(R11, RDI);
+#endif
+      mov_load(R8, R11, CTX_PAGES);
+      mov_load(R9, R11, CTX_PAGE_COUNT);
+      mov_load(R10, R11, CTX_REL_BASE);
+   }
+
+   // param i of the instruction at ip into reg
+   void load_param(reg_t const reg, offset_t const ip, int const i, int const mode)
+   {
+      if (mode == MOD_IMMEDIATE)
+      {
+         load_cell(reg, ip + i);
+         return;
+      }
+
+      load_cell(RDX, ip + i);
+      if (mode == MOD_RELBASE) alu_rr(0x01, RDX, R10);
+      translate(ip);
+      mov_load_cell(reg);
+   }
+
+   // rax into the cell addressed by param i of the instruction at ip
+   void store_param(offset_t const ip, int const i, int const mode)
+   {
+      load_cell(RDX, ip + i);
+      if (mode == MOD_RELBASE) alu_rr(0x01, RDX, R10);
+
+      // a write over a decoded instruction is left to the interpreter
+      cmp_r_mem8(RDX, R11, CTX_DECODED_SIZE);
+      size_t const skip = jcc(CC_AE);
+      mov_load(RCX, R11, CTX_DECODED);
+      emit({ 0x80, 0x3C, 0xD1, 0x00 });                  // cmp byte [rcx + rdx*8], 0
+      fallback_if(CC_NE, ip);
+      bind(skip);
+
+      // so is a write to a page shared with another copy (or the zero page)
+      translate(ip);
+      emit({ 0x80, 0x79, PAGE_SHARED, 0x00 });           // cmp byte [rcx + shared], 0
+      fallback_if(CC_NE, ip);
+
+      emit({ 0x48, 0x89, 0x84, 0xD1 });                  // mov [rcx + rdx*8 + cells], rax
+      emit32(PAGE_CELLS);
+   }
+
+   void add() { alu_rr(0x01, RAX, RCX); }
+
+   void mul() { emit({ 0x48, 0x0F, 0xAF, 0xC1 }); }      // imul rax, rcx
+
+   void compare(uint8_t const cc)
+   {
+      alu_rr(0x39, RAX, RCX);
+      emit({ 0x0F, static_cast<uint8_t>(0x90 | cc), 0xC0 }); // setcc al
+      emit({ 0x0F, 0xB6, 0xC0 });                         // movzx eax, al
+   }
+
+   void baseoff() { alu_rr(0x01, R10, RAX); }
+
+   // the condition is in rax; leaves the block either way
+   void jump(offset_t const ip, bool const if_nonzero, int const mode, offset_t const next)
+   {
+      alu_rr(0x85, RAX, RAX);
+      size_t const not_taken = jcc(if_nonzero ? CC_E : CC_NE);
+      load_param(RAX, ip, 2, mode);
+      mov_store(R11, CTX_IP, RAX);
+      size_t const done = jmp();
+      bind(not_taken);
+      mov_mem_imm32(R11, CTX_IP, static_cast<int32_t>(next));
+      bind(done);
+      leave(EXIT_NEXT, executed + 1);
+   }
+
+   void exit_to(offset_t const ip)
+   {
+      mov_mem_imm32(R11, CTX_IP, static_cast<int32_t>(ip));
+      leave(EXIT_NEXT, executed);
+   }
+
+   // out of line stubs that hand the faulting instruction to the
+   // interpreter, counting only the instructions before it
+   void emit_fallbacks()
+   {
+      for (auto const& fallback : fallbacks)
+      {
+         bind(fallback.pos);
+         mov_mem_imm32(R11, CTX_IP, static_cast<int32_t>(fallback.ip));
+         leave(EXIT_FALLBACK, fallback.executed);
+      }
+   }
+
+private:
+   void emit(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+
+   void emit32(int32_t const value)
+   {
+      for (int i = 0; i < 4; ++i)
+         code.push_back(static_cast<uint8_t>(value >> (i * 8)));
+   }
+
+   static uint8_t rex(reg_t const reg, reg_t const rm)
+   {
+      return static_cast<uint8_t>(0x48 | ((reg >> 3) << 2) | (rm >> 3));
+   }
+
+   void mov_rr(reg_t const dst, reg_t const src)
+   {
+      emit({ rex(src, dst), 0x89, static_cast<uint8_t>(0xC0 | (src & 7) << 3 | (dst & 7)) });
+   }
+
+   void alu_rr(uint8_t const opcode, reg_t const dst, reg_t const src)
+   {
+      emit({ rex(src, dst), opcode, static_cast<uint8_t>(0xC0 | (src & 7) << 3 | (dst & 7)) });
+   }
+
+   // mov reg, [base + disp32]
+   void mov_load(reg_t const reg, reg_t const base, int32_t const disp)
+   {
+      emit({ rex(reg, base), 0x8B, static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)) });
+      emit32(disp);
+   }
+
+   // mov [base + disp32], reg
+   void mov_store(reg_t const base, int32_t const disp, reg_t const reg)
+   {
+      emit({ rex(reg, base), 0x89, static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)) });
+      emit32(disp);
+   }
+
+   // mov qword [base + disp32], imm32
+   void mov_mem_imm32(reg_t const base, int32_t const disp, int32_t const value)
+   {
+      emit({ rex(RAX, base), 0xC7, static_cast<uint8_t>(0x80 | (base & 7)) });
+      emit32(disp);
+      emit32(value);
+   }
+
+   // cmp reg, [base + disp8]
+   void cmp_r_mem8(reg_t const reg, reg_t const base, int8_t const disp)
+   {
+      emit({ rex(reg, base), 0x3B, static_cast<uint8_t>(0x40 | (reg & 7) << 3 | (base & 7)), static_cast<uint8_t>(disp) });
+   }
+
+   // mov reg, [r8 + index*8]
+   void mov_load_indexed(reg_t const reg, reg_t const index)
+   {
+      emit({ static_cast<uint8_t>(rex(reg, R8) | ((index >> 3) << 1)), 0x8B,
+             static_cast<uint8_t>(0x04 | (reg & 7) << 3), static_cast<uint8_t>(0xC0 | (index & 7) << 3) });
+   }
+
+   // mov reg, [rcx + rdx*8 + cells]
+   void mov_load_cell(reg_t const reg)
+   {
+      emit({ rex(reg, RAX), 0x8B, static_cast<uint8_t>(0x84 | (reg & 7) << 3), 0xD1 });
+      emit32(PAGE_CELLS);
+   }
+
+   // a cell of the program image; its page always exists, but may have
+   // been replaced by a private copy, so the table is read every time
+   void load_cell(reg_t const reg, offset_t const off)
+   {
+      mov_load(RCX, R8, static_cast<int32_t>((off >> MEMORY_PAGE_BITS) * 8));
+      mov_load(reg, RCX, static_cast<int32_t>(PAGE_CELLS + (off & MEMORY_PAGE_MASK) * 8));
+   }
+
+   // the address in rdx into page (rcx) and index (rdx); an address
+   // outside the table goes to the interpreter. table entries are never
+   // null, untouched pages read as the shared zero page
+   void translate(offset_t const ip)
+   {
+      mov_rr(RCX, RDX);
+      emit({ 0x48, 0xC1, 0xE9, MEMORY_PAGE_BITS });      // shr rcx, page bits
+      alu_rr(0x39, RCX, R9);
+      fallback_if(CC_AE, ip);
+      mov_load_indexed(RCX, RCX);
+      emit({ 0x81, 0xE2 });                               // and edx, page mask
+      emit32(static_cast<int32_t>(MEMORY_PAGE_MASK));
+   }
+
+   void leave(int64_t const reason, int const count)
+   {
+      mov_store(R11, CTX_REL_BASE, R10);
+      mov_mem_imm32(R11, CTX_EXIT, static_cast<int32_t>(reason));
+      mov_mem_imm32(R11, CTX_EXECUTED, count);
+      emit({ 0xC3 });
+   }
+
+   // forward jumps; the returned position is patched by bind()
+   size_t jcc(uint8_t const cc)
+   {
+      emit({ 0x0F, static_cast<uint8_t>(0x80 | cc) });
+      emit32(0);
+      return code.size() - 4;
+   }
+
+   size_t jmp()
+   {
+      emit({ 0xE9 });
+      emit32(0);
+      return code.size() - 4;
+   }
+
+   void bind(size_t const pos)
+   {
+      int32_t const rel = static_cast<int32_t>(code.size() - (pos + 4));
+      std::memcpy(&code[pos], &rel, sizeof(rel));
+   }
+
+   void fallback_if(uint8_t const cc, offset_t const ip)
+   {
+      fallbacks.push_back({ jcc(cc), ip, executed });
+   }
+};
+
+static bool is_compilable(decoded_t const& op)
+{
+   auto readable = [](int const mode) {return mode <= MOD_RELBASE; };
+   auto writable = [](int const mode) {return mode == MOD_POSITION || mode == MOD_RELBASE; };
+
+   switch (op.opcode)
+   {
+   case OP_ADD:
+   case OP_MUL:
+   case OP_LS:
+   case OP_EQ:       return readable(op.mod1) && readable(op.mod2) && writable(op.mod3);
+   case OP_JMPNZ:
+   case OP_JMPZ:     return readable(op.mod1) && readable(op.mod2);
+   case OP_BASEOFF:  return readable(op.mod1);
+   default:          return false;
+   }
+}
+
+struct compiled_block_t
+{
+   std::vector<uint8_t> code;
+   int                  instructions = 0;
+   offset_t             end = 0;
+};
+
+static compiled_block_t compile_block(decoded_stream_t const& decoded, offset_t const start)
+{
+   // operands are addressed with a 32-bit displacement from the memory base
+   constexpr offset_t max_address = (offset_t{ 1 } << 28);
+
+   assembler_t a;
+   a.prologue();
+
+   offset_t ip = start;
+   int count = 0;
+   bool terminated = false;
+
+   while (count < MAX_BLOCK_INSTRUCTIONS && !terminated)
+   {
+      if (static_cast<size_t>(ip) >= decoded.size()) break;
+
+      // superinstructions are compiled as their two halves
+      decoded_t op = decoded[ip];
+      op.opcode = static_cast<uint8_t>(base_opcode(op.opcode));
+      if (op.opcode == 0 || !is_compilable(op)) break;
+      if (op.next > decoded.size() || op.next >= max_address) break;
+
+      switch (op.opcode)
+      {
+      case OP_ADD:
+      case OP_MUL:
+      case OP_LS:
+      case OP_EQ:
+         a.load_param(RAX, ip, 1, op.mod1);
+         a.load_param(RCX, ip, 2, op.mod2);
+         if (op.opcode == OP_ADD) a.add();
+         else if (op.opcode == OP_MUL) a.mul();
+         else a.compare(op.opcode == OP_LS ? CC_L : CC_E);
+         a.store_param(ip, 3, op.mod3);
+         break;
+      case OP_BASEOFF:
+         a.load_param(RAX, ip, 1, op.mod1);
+         a.baseoff();
+         break;
+      case OP_JMPNZ:
+      case OP_JMPZ:
+         a.load_param(RAX, ip, 1, op.mod1);
+         a.jump(ip, op.opcode == OP_JMPNZ, op.mod2, op.next);
+         terminated = true;
+         break;
+      }
+
+      ip = op.next;
+      count++;
+      a.next_instruction();
+   }
+
+   if (count == 0) return {};
+
+   if (!terminated) a.exit_to(ip);
+   a.emit_fallbacks();
+
+   return { a.bytes(), count, ip };
+}
+
+static jit_block_t find_block(jit_cache_t& cache, decoded_stream_t const& decoded, offset_t const ip)
+{
+   if (ip < 0 || static_cast<size_t>(ip) >= cache.blocks.size())
+      return nullptr;
+
+   if (cache.attempted[ip] == 0)
+   {
+      cache.attempted[ip] = 1;
+
+      auto const compiled = compile_block(decoded, ip);
+      if (compiled.instructions != 0)
+      {
+         void* entry = cache.code.append(compiled.code);
+         if (entry == nullptr)
+         {
+            // out of executable memory: start over with this block only
+            cache.flush();
+            cache.attempted[ip] = 1;
+            entry = cache.code.append(compiled.code);
+         }
+
+         cache.blocks[ip] = reinterpret_cast<jit_block_t>(entry);
+         cache.lengths[ip] = static_cast<uint8_t>(compiled.instructions);
+         cache.ends[ip] = compiled.end;
+         std::fill(cache.covered.begin() + ip, cache.covered.begin() + compiled.end, 1);
+         cache.count++;
+      }
+   }
+
+   return cache.blocks[ip];
+}
+
+#endif
+
+jit_program_t::jit_program_t(memory_t const& mem) :
+   program(mem), cache(std::make_shared<jit_cache_t>(program.decoded))
+{
+}
+
+jit_program_t::jit_program_t(program_t const& prog) :
+   program(prog), cache(std::make_shared<jit_cache_t>(program.decoded))
+{
+}
+
+jit_cache_t& jit_program_t::current_cache()
+{
+   if (!cache->compiled_from(program.decoded))
+      cache = std::make_shared<jit_cache_t>(program.decoded);
+
+   return *cache;
+}
+
+size_t jit_program_t::compiled_blocks() const
+{
+   return cache->count;
+}
+
+void jit_program_t::overwritten(decoded_stream_t const* const stream)
+{
+   offset_t const off = program.invalidated;
+   program.invalidated = -1;
+
+   // a stream that was shared has been copied, and gets a cache of its own
+   if (off >= 0 && program.decoded.get() == stream && cache->compiled_from(program.decoded))
+      cache->drop(off);
+}
+
+void jit_program_t::write(offset_t const off, memory_unit const value)
+{
+   decoded_stream_t const* const stream = program.decoded.get();
+   program.write(off, value);
+   overwritten(stream);
+}
+
+bool jit_program_t::step(program_t::input_t& fin, program_t::output_t& fout)
+{
+   decoded_stream_t const* const stream = program.decoded.get();
+   bool const stop = program.step(fin, fout);
+   overwritten(stream);
+   return stop;
+}
+
+void jit_program_t::execute(program_t::input_t fin, program_t::output_t fout)
+{
+#if INTCODE_JIT
+   // the interpreter counts the trace and the profile instruction by instruction
+   if (program.tracer != nullptr || program.profile != nullptr)
+   {
+      program.execute(fin, fout);
+      return;
+   }
+
+   while (!program.halted && program.executed < program.limit)
+   {
+      jit_cache_t& current = current_cache();
+      jit_block_t block = find_block(current, *program.decoded, program.ip);
+
+      // a block that could take the count past the limit is left to the interpreter
+      if (block != nullptr && program.limit - program.executed >= current.lengths[program.ip])
+      {
+         jit_context_t context
+         {
+            program.memory.page_table(), static_cast<int64_t>(program.memory.page_table_size()),
+            program.decoded->data(), static_cast<int64_t>(program.decoded->size()),
+            program.ip, program.rel_base, EXIT_NEXT, 0
+         };
+
+         block(&context);
+
+         program.ip = context.ip;
+         program.rel_base = context.rel_base;
+         program.executed += context.executed;
+
+         if (context.exit == EXIT_NEXT)
+            continue;
+      }
+
+      // IN, OUT, HALT, code the compiler does not handle and fallbacks
+      if (step(fin, fout))
+         return;
+   }
+#else
+   program.execute(fin, fout);
+#endif
+}
+
+bool jit_program_t::execute_for(uint64_t const budget, program_t::input_t fin, program_t::output_t fout)
+{
+   struct restore_t
+   {
+      uint64_t& limit;
+      ~restore_t() { limit = program_t::NO_LIMIT; }
+   } restore{ program.limit };
+
+   program.limit = budget < program_t::NO_LIMIT - program.executed ? program.executed + budget : program_t::NO_LIMIT;
+   execute(fin, fout);
+
+   return !program.halted && program.executed >= program.limit;
+}
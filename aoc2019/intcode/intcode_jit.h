@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+
+#include "intcode.h"
+
+// native code generation is only implemented for x86-64; elsewhere
+// jit_program_t runs everything on the interpreter
+#ifndef INTCODE_JIT
+#if defined(__x86_64__) || defined(_M_X64)
+#define INTCODE_JIT 1
+#else
+#define INTCODE_JIT 0
+#endif
+#endif
+
+struct jit_cache_t;
+
+// Runs an Intcode program by translating its basic blocks to x86-64 code.
+// IN, OUT and HALT, as well as any access the compiled code cannot prove
+// safe (memory growth, a write over a decoded instruction), are handed to
+// the interpreter one instruction at a time; an overwritten instruction
+// only drops the blocks it is part of. Blocks keep the instruction count
+// of the interpreter and only run when they fit in the budget; a program
+// with a trace or a profile runs on the interpreter. Copies of a
+// jit_program_t share compiled code as long as they share the decoded
+// stream, so they must not run concurrently.
+class jit_program_t
+{
+   program_t                    program;
+   std::shared_ptr<jit_cache_t> cache;
+
+public:
+   jit_program_t(memory_t const& mem);
+
+   jit_program_t(program_t const& prog);
+
+   // same contract as program_t::execute
+   void execute(program_t::input_t fin, program_t::output_t fout);
+
+   // same contract as program_t::execute_for
+   bool execute_for(uint64_t budget, program_t::input_t fin, program_t::output_t fout);
+
+   bool is_halted() const { return program.is_halted(); }
+
+   uint64_t instructions() const { return program.instructions(); }
+
+   void set_trace(trace_writer_t* const target) { program.set_trace(target); }
+
+   void set_profile(profile_t* const target) { program.set_profile(target); }
+
+   memory_unit read(offset_t const off) { return program.read(off); }
+
+   void write(offset_t const off, memory_unit const value);
+
+   size_t compiled_blocks() const;
+
+private:
+   jit_cache_t& current_cache();
+
+   // drops the blocks over the decoded instruction the last write cleared, if any
+   void overwritten(decoded_stream_t const* const stream);
+
+   // one instruction on the interpreter
+   bool step(program_t::input_t& fin, program_t::output_t& fout);
+};
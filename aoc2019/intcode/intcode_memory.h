@@ -0,0 +1,244 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+
+using memory_unit = long long;
+using memory_t = std::vector<memory_unit>;
+using offset_t = ptrdiff_t;
+
+constexpr int    MEMORY_PAGE_BITS = 10;
+constexpr size_t MEMORY_PAGE_CELLS = size_t{ 1 } << MEMORY_PAGE_BITS;
+constexpr size_t MEMORY_PAGE_MASK = MEMORY_PAGE_CELLS - 1;
+// pages below this are kept in a table indexed by page number; the rest of
+// the 2^63 cell address space is sparse
+constexpr size_t MEMORY_DENSE_PAGES = size_t{ 1 } << 12;
+
+// a page is shared by the copies of a memory until one of them writes to
+// it; shared is set when the memory is copied and is only cleared by an
+// owner that finds itself the last one
+struct memory_page_t
+{
+   std::atomic<bool> shared{ false };
+   memory_unit       cells[MEMORY_PAGE_CELLS] = {};
+
+   // pages alive in the process, for measuring sharing
+   static inline std::atomic<size_t> live{ 0 };
+
+   memory_page_t() { live++; }
+
+   memory_page_t(memory_page_t const& other)
+   {
+      std::copy(std::begin(other.cells), std::end(other.cells), std::begin(cells));
+      live++;
+   }
+
+   ~memory_page_t() { live--; }
+};
+
+// program images are laid out as memory pages, see intcode_image.h
+static_assert(sizeof(memory_page_t) == sizeof(memory_unit) * (MEMORY_PAGE_CELLS + 1));
+static_assert(offsetof(memory_page_t, cells) == sizeof(memory_unit));
+
+// Intcode memory split in pages that are allocated on the first write
+// (reading an untouched cell yields 0) and shared copy-on-write between
+// copies, so copying a machine costs one pointer per page. The dense
+// region at the bottom, where the program and usually its stack live, is
+// a table; pages above it are found through a hash map, so a write near
+// 2^40 costs one page rather than zero-filling everything below it.
+//
+// Table entries are never null: untouched pages point at a shared page of
+// zeros, so an access inside the table is one unsigned compare (which also
+// rejects negative offsets) and, for writes, a test of the shared flag.
+// Everything else takes the slow path.
+class paged_memory_t
+{
+   using page_ptr = std::shared_ptr<memory_page_t>;
+
+   // null where the table points at the zero page
+   std::vector<page_ptr>                  pages;
+   // raw view of pages, for the fast paths and compiled code
+   std::vector<memory_page_t*>            table;
+   std::unordered_map<size_t, page_ptr>   sparse;
+
+public:
+   paged_memory_t() = default;
+
+   // reserve is the extent the program is known to address; the table is
+   // sized to cover it up front
+   paged_memory_t(memory_t const& image, size_t const reserve = 0)
+   {
+      size_t const count = (image.size() + MEMORY_PAGE_MASK) >> MEMORY_PAGE_BITS;
+      size_t const reserved = std::min(MEMORY_DENSE_PAGES, (reserve + MEMORY_PAGE_MASK) >> MEMORY_PAGE_BITS);
+
+      pages.resize(std::max(count, reserved));
+      table.resize(pages.size(), zero_page());
+
+      for (size_t page = 0; page < count; ++page)
+      {
+         auto first = image.begin() + page * MEMORY_PAGE_CELLS;
+         auto last = image.begin() + std::min(image.size(), (page + 1) * MEMORY_PAGE_CELLS);
+
+         pages[page] = std::make_shared<memory_page_t>();
+         std::copy(first, last, pages[page]->cells);
+         table[page] = pages[page].get();
+      }
+   }
+
+   // pages that live in a mapped image and are marked shared; owner keeps
+   // the mapping alive while any of them is referenced
+   paged_memory_t(memory_page_t* const mapped, size_t const count, std::shared_ptr<void> const& owner, size_t const reserve = 0)
+   {
+      size_t const reserved = std::min(MEMORY_DENSE_PAGES, (reserve + MEMORY_PAGE_MASK) >> MEMORY_PAGE_BITS);
+
+      pages.resize(std::max(count, reserved));
+      table.resize(pages.size(), zero_page());
+
+      for (size_t page = 0; page < count; ++page)
+      {
+         pages[page] = page_ptr(owner, mapped + page);
+         table[page] = mapped + page;
+      }
+   }
+
+   paged_memory_t(paged_memory_t const& other) : pages(other.pages), table(other.table), sparse(other.sparse)
+   {
+      share();
+   }
+
+   paged_memory_t& operator=(paged_memory_t const& other)
+   {
+      if (this != &other)
+      {
+         pages = other.pages;
+         table = other.table;
+         sparse = other.sparse;
+         share();
+      }
+      return *this;
+   }
+
+   paged_memory_t(paged_memory_t&&) = default;
+   paged_memory_t& operator=(paged_memory_t&&) = default;
+
+   memory_unit read(offset_t const off) const
+   {
+      size_t const page = static_cast<size_t>(off) >> MEMORY_PAGE_BITS;
+      if (page < table.size())
+         return table[page]->cells[off & MEMORY_PAGE_MASK];
+
+      return read_far(off);
+   }
+
+   void write(offset_t const off, memory_unit const value)
+   {
+      size_t const page = static_cast<size_t>(off) >> MEMORY_PAGE_BITS;
+      if (page < table.size())
+      {
+         memory_page_t* p = table[page];
+         if (!p->shared.load(std::memory_order_relaxed))
+         {
+            p->cells[off & MEMORY_PAGE_MASK] = value;
+            return;
+         }
+      }
+
+      write_slow(off, value);
+   }
+
+   // pages referenced by this memory, shared or not
+   size_t page_count() const
+   {
+      return sparse.size() + std::count_if(pages.begin(), pages.end(), [](auto const& p) {return p != nullptr; });
+   }
+
+   memory_page_t* const* page_table() const { return table.data(); }
+
+   size_t page_table_size() const { return table.size(); }
+
+private:
+   // shared by every memory and never written, because it is always marked shared
+   static memory_page_t* zero_page()
+   {
+      static memory_page_t* const page = []() {
+         static memory_page_t zeros;
+         zeros.shared.store(true, std::memory_order_relaxed);
+         return &zeros; }();
+      return page;
+   }
+
+   memory_unit read_far(offset_t const off) const
+   {
+      if (off < 0) throw std::runtime_error("index out of bounds");
+
+      auto it = sparse.find(static_cast<size_t>(off) >> MEMORY_PAGE_BITS);
+      return it != sparse.end() ? it->second->cells[off & MEMORY_PAGE_MASK] : 0;
+   }
+
+   void write_slow(offset_t const off, memory_unit const value)
+   {
+      if (off < 0) throw std::runtime_error("index out of bounds");
+
+      make_writable(static_cast<size_t>(off) >> MEMORY_PAGE_BITS)->cells[off & MEMORY_PAGE_MASK] = value;
+   }
+
+   void share()
+   {
+      for (auto const& p : pages)
+      {
+         if (p != nullptr)
+            mark_shared(*p);
+      }
+
+      for (auto const& [page, p] : sparse)
+         mark_shared(*p);
+   }
+
+   // a page that is already shared is left untouched, so that the pages of
+   // a mapped image are not dirtied by copying a memory
+   static void mark_shared(memory_page_t& page)
+   {
+      if (!page.shared.load(std::memory_order_relaxed))
+         page.shared.store(true, std::memory_order_relaxed);
+   }
+
+   memory_page_t* make_writable(size_t const page)
+   {
+      // an image larger than the dense region keeps all its pages in the table
+      if (page >= MEMORY_DENSE_PAGES && page >= pages.size())
+         return make_owned(sparse[page]);
+
+      if (page >= pages.size())
+      {
+         pages.resize(page + 1);
+         table.resize(page + 1, zero_page());
+      }
+
+      table[page] = make_owned(pages[page]);
+      return table[page];
+   }
+
+   static memory_page_t* make_owned(page_ptr& p)
+   {
+      if (p == nullptr)
+         p = std::make_shared<memory_page_t>();
+      else if (p.use_count() == 1)
+      {
+         // use_count is a relaxed load; the fence orders the reads other
+         // threads made of the page before they let go of it ahead of the
+         // writes to come
+         std::atomic_thread_fence(std::memory_order_acquire);
+         p->shared.store(false, std::memory_order_relaxed);
+      }
+      else
+         p = std::make_shared<memory_page_t>(*p);
+
+      return p.get();
+   }
+};
@@ -0,0 +1,131 @@
+// intcode_parallel.cpp : Independent Intcode runs spread over a pool of threads.
+//
+
+#include <memory>
+#include <algorithm>
+#include <utility>
+
+#include "intcode.h"
+#include "intcode_checkpoint.h"
+#include "intcode_parallel.h"
+
+namespace
+{
+   // chunks per worker; small enough to balance runs of uneven length,
+   // large enough that the shared counter is rarely touched
+   constexpr size_t CHUNKS_PER_WORKER = 16;
+}
+
+thread_pool_t::thread_pool_t(size_t size)
+{
+   if (size == 0)
+      size = std::max(1u, std::thread::hardware_concurrency());
+
+   for (size_t worker = 1; worker < size; ++worker)
+      threads.emplace_back([this, worker]() { work(worker); });
+}
+
+thread_pool_t::~thread_pool_t()
+{
+   {
+      std::unique_lock<std::mutex> l(mt);
+      stopping = true;
+   }
+   wake.notify_all();
+
+   for (auto& thread : threads)
+      thread.join();
+}
+
+void thread_pool_t::work(size_t const worker)
+{
+   size_t seen = 0;
+
+   while (true)
+   {
+      {
+         std::unique_lock<std::mutex> l(mt);
+         wake.wait(l, [this, seen]() { return stopping || generation != seen; });
+         if (stopping) return;
+         seen = generation;
+      }
+
+      drain(worker);
+
+      std::unique_lock<std::mutex> l(mt);
+      if (--busy == 0) done.notify_one();
+   }
+}
+
+void thread_pool_t::drain(size_t const worker)
+{
+   while (true)
+   {
+      size_t const first = next.fetch_add(chunk, std::memory_order_relaxed);
+      if (first >= count) return;
+
+      size_t const last = std::min(count, first + chunk);
+      for (size_t index = first; index < last; ++index)
+      {
+         try
+         {
+            (*job)(index, worker);
+         }
+         catch (...)
+         {
+            std::unique_lock<std::mutex> l(mt);
+            if (error == nullptr) error = std::current_exception();
+            next.store(count, std::memory_order_relaxed);
+            return;
+         }
+      }
+   }
+}
+
+void thread_pool_t::for_each(size_t const count, job_t const& f)
+{
+   std::unique_lock<std::mutex> r(running);
+
+   {
+      std::unique_lock<std::mutex> l(mt);
+      job = &f;
+      this->count = count;
+      chunk = std::max<size_t>(1, count / (size() * CHUNKS_PER_WORKER));
+      next.store(0, std::memory_order_relaxed);
+      error = nullptr;
+      busy = threads.size();
+      generation++;
+   }
+   wake.notify_all();
+
+   drain(0);
+
+   std::unique_lock<std::mutex> l(mt);
+   done.wait(l, [this]() { return busy == 0; });
+   job = nullptr;
+
+   if (error != nullptr)
+      std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+std::vector<memory_t> run_parallel(thread_pool_t& pool, memory_t const& memory, std::vector<memory_t> const& inputs)
+{
+   std::vector<memory_t> outputs(inputs.size());
+   std::vector<std::unique_ptr<checkpoint_t>> starts(pool.size());
+
+   pool.for_each(inputs.size(), [&](size_t const index, size_t const worker) {
+      auto& start = starts[worker];
+      if (start == nullptr)
+         start = std::make_unique<checkpoint_t>(program_t{ memory });
+
+      start->run(inputs[index], outputs[index]); });
+
+   return outputs;
+}
+
+std::vector<memory_t> run_parallel(thread_pool_t& pool, program_image_t const& image, std::vector<memory_t> const& inputs)
+{
+   // every page of a mapped image is owned through the one reference count
+   // of the mapping, which forks on all the workers would contend for
+   return run_parallel(pool, image.to_memory(), inputs);
+}
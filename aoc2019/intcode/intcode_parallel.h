@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+#include "intcode_memory.h"
+
+// only the pool is needed by code that runs its own interpreter, so the
+// engine is not included here
+class program_image_t;
+
+// A fixed set of worker threads that run the items of one job at a time.
+// The thread calling for_each works on the job as worker 0, so a pool of
+// size n starts n - 1 threads, and a pool of size 1 runs everything on the
+// caller. Items are handed out in chunks from a shared counter, so a slow
+// item holds up only the worker that has it.
+class thread_pool_t
+{
+   using job_t = std::function<void(size_t, size_t)>;
+
+   std::vector<std::thread> threads;
+
+   std::mutex               running;    // one for_each at a time
+   std::mutex               mt;
+   std::condition_variable  wake;
+   std::condition_variable  done;
+
+   // the job being run
+   job_t const*             job = nullptr;
+   size_t                   count = 0;
+   size_t                   chunk = 1;
+   std::atomic<size_t>      next{ 0 };
+   size_t                   generation = 0;
+   size_t                   busy = 0;
+   std::exception_ptr       error;
+   bool                     stopping = false;
+
+   void work(size_t const worker);
+
+   void drain(size_t const worker);
+
+public:
+   // threads is the size of the pool; 0 takes one per hardware thread
+   explicit thread_pool_t(size_t threads = 0);
+
+   ~thread_pool_t();
+
+   thread_pool_t(thread_pool_t const&) = delete;
+   thread_pool_t& operator=(thread_pool_t const&) = delete;
+
+   size_t size() const { return threads.size() + 1; }
+
+   // calls f(index, worker) for every index below count and returns when
+   // all the calls have; worker is below size() and no two calls with the
+   // same worker run at once. if a call throws, the items not yet started
+   // are skipped and the first exception is rethrown here. f must not call
+   // for_each on the same pool
+   void for_each(size_t const count, job_t const& f);
+};
+
+// Runs the program once per input set, as program_t::run would, on the
+// threads of pool and returns the outputs of every run, in the order of
+// the inputs. The memory is only read: each worker decodes a program_t of
+// its own from it, runs that up to its first IN (see checkpoint_t) and
+// forks it from there for every run, so that no two threads touch the same
+// page or reference count.
+std::vector<memory_t> run_parallel(thread_pool_t& pool, memory_t const& memory, std::vector<memory_t> const& inputs);
+
+std::vector<memory_t> run_parallel(thread_pool_t& pool, program_image_t const& image, std::vector<memory_t> const& inputs);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include "intcode_memory.h"
+
+// Execution counts collected by program_t while a profile is set on it.
+// Superinstructions are counted as the two instructions they are made of.
+struct profile_t
+{
+   // by opcode
+   std::array<uint64_t, 100>       opcodes{};
+   // by opcode and parameter modes, see mode_index
+   std::array<uint64_t, 100 * 27>  modes{};
+   // by instruction address
+   std::vector<uint64_t>           addresses;
+
+   static constexpr size_t mode_index(int const opcode, int const mod1, int const mod2, int const mod3)
+   {
+      return static_cast<size_t>(opcode) * 27 + mod1 + 3 * mod2 + 9 * mod3;
+   }
+
+   void count(offset_t const ip, int const opcode, int const mod1, int const mod2, int const mod3)
+   {
+      opcodes[opcode]++;
+      if (mod1 <= 2 && mod2 <= 2 && mod3 <= 2)
+         modes[mode_index(opcode, mod1, mod2, mod3)]++;
+
+      if (static_cast<size_t>(ip) >= addresses.size())
+         addresses.resize(static_cast<size_t>(ip) + 1, 0);
+      addresses[ip]++;
+   }
+
+   uint64_t total() const
+   {
+      uint64_t sum = 0;
+      for (auto const n : opcodes)
+         sum += n;
+      return sum;
+   }
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <stdexcept>
+
+#include "intcode.h"
+
+// Re-runs a program on the inputs of a trace written by trace_writer_t.
+// The machine is stepped one instruction at a time and every input has to
+// be consumed at the instruction count the log gives, otherwise a
+// runtime_error says where the run left the recorded one. A fork of the
+// machine is kept every interval instructions, up to max_snapshots of them
+// with the oldest dropped first, so that seek goes back to any point by
+// running forward from the closest snapshot before it.
+class trace_replay_t
+{
+   struct snapshot_t
+   {
+      program_t program;
+      size_t    next_input = 0;
+   };
+
+   struct replay_input_t
+   {
+      trace_replay_t& replay;
+
+      bool ready() const { return replay.current.next_input < replay.entries.size(); }
+
+      memory_unit operator()()
+      {
+         trace_entry_t const& entry = replay.entries[replay.current.next_input];
+         uint64_t const instruction = replay.current.program.instructions() - 1;
+         if (entry.instruction != instruction)
+            throw std::runtime_error("trace diverges at instruction " + std::to_string(instruction) +
+               ", input " + std::to_string(replay.current.next_input) + " was recorded at " + std::to_string(entry.instruction));
+
+         replay.current.next_input++;
+         return entry.value;
+      }
+   };
+
+   std::vector<trace_entry_t> entries;
+   uint64_t                   interval;
+   size_t                     max_snapshots;
+   snapshot_t                 start;
+   std::deque<snapshot_t>     snapshots;
+   snapshot_t                 current;
+
+public:
+   trace_replay_t(memory_t const& memory, std::vector<trace_entry_t> trace,
+                  uint64_t const interval = 1'000'000, size_t const max_snapshots = 64) :
+      entries(std::move(trace)), interval(std::max<uint64_t>(interval, 1)), max_snapshots(max_snapshots),
+      start{ program_t{ memory }, 0 }, current{ start.program.fork(), 0 }
+   {
+   }
+
+   // runs forward until the machine has executed target instructions;
+   // outputs are passed to fout as void(memory_unit). returns false if the
+   // program halted or needs an input past the end of the log first
+   template <typename Output>
+   bool run_to(uint64_t const target, Output&& fout)
+   {
+      replay_input_t fin{ *this };
+      auto output = [&fout](memory_unit const value) { fout(value); return false; };
+
+      while (current.program.instructions() < target)
+      {
+         if (current.program.step(fin, output))
+            return false;
+
+         uint64_t const position = current.program.instructions();
+         if (position % interval == 0 && max_snapshots > 0 &&
+            (snapshots.empty() || snapshots.back().program.instructions() < position))
+         {
+            snapshots.push_back({ current.program.fork(), current.next_input });
+            if (snapshots.size() > max_snapshots)
+               snapshots.pop_front();
+         }
+      }
+
+      return true;
+   }
+
+   // runs until the program halts or the log runs out
+   template <typename Output>
+   void run(Output&& fout)
+   {
+      run_to(std::numeric_limits<uint64_t>::max(), fout);
+   }
+
+   // puts the machine in the state it had after target instructions,
+   // going back if needed; outputs on the way are dropped
+   bool seek(uint64_t const target)
+   {
+      if (target < current.program.instructions())
+      {
+         snapshot_t const* closest = &start;
+         for (auto const& snapshot : snapshots)
+            if (snapshot.program.instructions() <= target)
+               closest = &snapshot;
+
+         current = { closest->program.fork(), closest->next_input };
+      }
+
+      return run_to(target, [](memory_unit) {});
+   }
+
+   uint64_t position() const { return current.program.instructions(); }
+
+   // inputs consumed so far, and in the whole log
+   size_t inputs_consumed() const { return current.next_input; }
+   size_t inputs() const { return entries.size(); }
+
+   size_t snapshot_count() const { return snapshots.size(); }
+
+   // the machine in its current state; changing it makes the replay diverge
+   program_t& machine() { return current.program; }
+};
@@ -0,0 +1,126 @@
+// intcode_trace.cpp : Binary input log of the Intcode tracer.
+//
+
+#include <istream>
+#include <ostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "intcode_trace.h"
+
+namespace
+{
+   constexpr char trace_magic[4] = { 'I', 'C', 'T', 'R' };
+   constexpr char trace_version = 1;
+
+   void write_varint(std::ostream& out, uint64_t value)
+   {
+      char bytes[10];
+      size_t size = 0;
+
+      while (value >= 0x80)
+      {
+         bytes[size++] = static_cast<char>((value & 0x7f) | 0x80);
+         value >>= 7;
+      }
+      bytes[size++] = static_cast<char>(value);
+
+      out.write(bytes, size);
+   }
+
+   // false at the end of the stream, before the first byte
+   bool read_varint(std::istream& in, uint64_t& value)
+   {
+      value = 0;
+
+      for (int shift = 0; shift < 64; shift += 7)
+      {
+         int const byte = in.get();
+         if (byte == std::char_traits<char>::eof())
+         {
+            if (shift == 0) return false;
+            throw std::runtime_error("truncated trace");
+         }
+
+         value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+         if ((byte & 0x80) == 0) return true;
+      }
+
+      throw std::runtime_error("invalid trace");
+   }
+
+   uint64_t zigzag(memory_unit const value)
+   {
+      return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+   }
+
+   memory_unit unzigzag(uint64_t const value)
+   {
+      return static_cast<memory_unit>(value >> 1) ^ -static_cast<memory_unit>(value & 1);
+   }
+}
+
+trace_writer_t::trace_writer_t(std::ostream& out, size_t const capacity) :
+   out(&out), ring(std::max<size_t>(capacity, 1))
+{
+   out.write(trace_magic, sizeof(trace_magic));
+   out.put(trace_version);
+}
+
+trace_writer_t::trace_writer_t(size_t const capacity) :
+   ring(std::max<size_t>(capacity, 1))
+{
+}
+
+void trace_writer_t::flush()
+{
+   if (out == nullptr || pending == 0) return;
+
+   for (uint64_t i = recorded - pending; i < recorded; ++i)
+   {
+      trace_entry_t const& entry = ring[i % ring.size()];
+      write_varint(*out, entry.instruction - last_instruction);
+      write_varint(*out, zigzag(entry.value));
+      last_instruction = entry.instruction;
+   }
+
+   pending = 0;
+   out->flush();
+}
+
+std::vector<trace_entry_t> trace_writer_t::recent() const
+{
+   std::vector<trace_entry_t> entries;
+
+   uint64_t const kept = std::min<uint64_t>(recorded, ring.size());
+   for (uint64_t i = recorded - kept; i < recorded; ++i)
+      entries.push_back(ring[i % ring.size()]);
+
+   return entries;
+}
+
+std::vector<trace_entry_t> read_trace(std::istream& in)
+{
+   char header[sizeof(trace_magic) + 1] = {};
+   in.read(header, sizeof(header));
+   if (!in || !std::equal(std::begin(trace_magic), std::end(trace_magic), header))
+      throw std::runtime_error("not an Intcode trace");
+   if (header[sizeof(trace_magic)] != trace_version)
+      throw std::runtime_error("unsupported trace version");
+
+   std::vector<trace_entry_t> entries;
+   uint64_t instruction = 0;
+
+   uint64_t delta = 0;
+   while (read_varint(in, delta))
+   {
+      uint64_t value = 0;
+      if (!read_varint(in, value))
+         throw std::runtime_error("truncated trace");
+
+      instruction += delta;
+      entries.push_back({ instruction, unzigzag(value) });
+   }
+
+   return entries;
+}
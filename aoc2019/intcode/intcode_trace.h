@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <iosfwd>
+#include <cstdint>
+
+#include "intcode_memory.h"
+
+// an input value and the number of instructions the program had executed
+// before the IN that consumed it
+struct trace_entry_t
+{
+   uint64_t    instruction = 0;
+   memory_unit value = 0;
+};
+
+// Records the inputs of a program_t set with set_trace. Entries go into a
+// ring of fixed capacity: with a stream, the ring is encoded into the log
+// every time it fills up and when the writer is flushed or destroyed;
+// without one, the ring only keeps the last entries, for a look at what a
+// machine was given before it went wrong.
+//
+// The log starts with the "ICTR" magic and a version byte, followed by one
+// pair of LEB128 varints per entry: the instructions executed since the
+// previous input and the zigzag encoded value.
+class trace_writer_t
+{
+   std::ostream*              out = nullptr;
+   std::vector<trace_entry_t> ring;
+   uint64_t                   recorded = 0;
+   size_t                     pending = 0;
+   uint64_t                   last_instruction = 0;
+
+public:
+   explicit trace_writer_t(std::ostream& out, size_t const capacity = 4096);
+
+   explicit trace_writer_t(size_t const capacity);
+
+   trace_writer_t(trace_writer_t const&) = delete;
+   trace_writer_t& operator=(trace_writer_t const&) = delete;
+
+   ~trace_writer_t() { flush(); }
+
+   void record(uint64_t const instruction, memory_unit const value)
+   {
+      ring[recorded % ring.size()] = { instruction, value };
+      ++recorded;
+
+      if (out != nullptr && ++pending == ring.size())
+         flush();
+   }
+
+   // encodes the entries recorded since the last flush
+   void flush();
+
+   uint64_t size() const { return recorded; }
+
+   // the entries still in the ring, oldest first
+   std::vector<trace_entry_t> recent() const;
+};
+
+// reads a log written by trace_writer_t; throws runtime_error if it is not one
+std::vector<trace_entry_t> read_trace(std::istream& in);
@@ -0,0 +1,515 @@
+#include <deque>
+#include <optional>
+
+#define FMT_HEADER_ONLY 1
+#include "fmt/core.h"
+#include "fmt/format.h"
+
+#include "cfg.h"
+#include "disassembler.h"
+
+namespace
+{
+   bool is_jump(decoded_t const& op)
+   {
+      return op.opcode == OP_JMPNZ || op.opcode == OP_JMPZ;
+   }
+
+   bool ends_block(decoded_t const& op)
+   {
+      return is_jump(op) || op.opcode == OP_HALT;
+   }
+
+   // true if the edge stays inside the routine of its block
+   bool is_local(cfg_edge_t const& edge)
+   {
+      return edge.kind != edge_kind_t::call && edge.kind != edge_kind_t::ret;
+   }
+
+   class cfg_builder_t
+   {
+      memory_t const&                  memory;
+      std::map<offset_t, decoded_t>    code;
+      // cells the code writes through a position operand. the other cells
+      // of the image are taken as constants, operands included, which holds
+      // only while no write can land anywhere else: once the code writes
+      // through a relative base operand, any cell may change and none is
+      // constant
+      std::set<offset_t>               written;
+      bool                             unresolved = false;
+      std::set<offset_t>               leaders{ 0 };
+      // call sites by the routine they call
+      std::map<offset_t, std::vector<offset_t>> calls;
+      cfg_t                            cfg;
+
+   public:
+      explicit cfg_builder_t(memory_t const& image) : memory(image)
+      {
+      }
+
+      cfg_t build()
+      {
+         explore();
+         split();
+         assign_functions();
+         link_returns();
+         find_loops();
+         return std::move(cfg);
+      }
+
+   private:
+      // a jump with a constant condition is either always or never taken
+      enum class branch_t { never, always, conditional };
+
+      // the value of an immediate operand, or of a positional one no
+      // instruction writes to; the operand cell itself must not be written
+      // either, or the instruction is not the one in the image
+      std::optional<memory_unit> constant_operand(offset_t const ip, int const k, int const mode) const
+      {
+         if (unresolved || written.count(ip + k) != 0)
+            return std::nullopt;
+
+         memory_unit const value = memory[ip + k];
+         if (mode == MOD_IMMEDIATE)
+            return value;
+         if (mode == MOD_POSITION && value >= 0 && static_cast<size_t>(value) < memory.size() && written.count(value) == 0)
+            return memory[value];
+         return std::nullopt;
+      }
+
+      branch_t branch(offset_t const ip, decoded_t const& op) const
+      {
+         auto const condition = constant_operand(ip, 1, op.mod1);
+         if (!condition) return branch_t::conditional;
+
+         return (*condition != 0) == (op.opcode == OP_JMPNZ) ? branch_t::always : branch_t::never;
+      }
+
+      std::optional<offset_t> target(offset_t const ip, decoded_t const& op) const
+      {
+         return constant_operand(ip, 2, op.mod2);
+      }
+
+      // the value an instruction stores at [base+k] if its operands are both immediate
+      std::optional<memory_unit> stored_constant(offset_t const ip) const
+      {
+         auto it = code.find(ip);
+         if (it == code.end()) return std::nullopt;
+
+         decoded_t const& op = it->second;
+         if ((op.opcode != OP_ADD && op.opcode != OP_MUL) ||
+            op.mod1 != MOD_IMMEDIATE || op.mod2 != MOD_IMMEDIATE || op.mod3 != MOD_RELBASE)
+            return std::nullopt;
+
+         auto const a = constant_operand(ip, 1, op.mod1);
+         auto const b = constant_operand(ip, 2, op.mod2);
+         if (!a || !b) return std::nullopt;
+
+         return op.opcode == OP_ADD ? *a + *b : *a * *b;
+      }
+
+      std::optional<offset_t> previous(offset_t const ip) const
+      {
+         auto it = code.lower_bound(ip);
+         if (it == code.begin()) return std::nullopt;
+         --it;
+         return it->second.next == static_cast<uint32_t>(ip) ? std::optional<offset_t>(it->first) : std::nullopt;
+      }
+
+      // an unconditional jump to a constant is a call if the straight line
+      // code before it stores the address that follows the jump at [base+k]
+      bool is_call(offset_t const ip, decoded_t const& op) const
+      {
+         if (!is_jump(op) || !target(ip, op) || branch(ip, op) != branch_t::always)
+            return false;
+
+         for (auto at = previous(ip); at && !ends_block(code.at(*at)); at = previous(*at))
+         {
+            auto const value = stored_constant(*at);
+            if (value && *value == op.next)
+               return true;
+         }
+
+         return false;
+      }
+
+      // reads every cell that no instruction found so far writes as a
+      // constant, and starts over whenever the code found writes to more,
+      // or writes through the relative base or a destination operand that
+      // is itself written
+      void explore()
+      {
+         while (true)
+         {
+            code.clear();
+            reach_code();
+
+            std::set<offset_t> writes;
+            bool anywhere = false;
+            for (auto const& [ip, op] : code)
+            {
+               int const modes[] = { op.mod1, op.mod2, op.mod3 };
+               int const dest = op.opcode == OP_IN ? 1 : (op.opcode == OP_ADD || op.opcode == OP_MUL || op.opcode == OP_LS || op.opcode == OP_EQ) ? 3 : 0;
+               if (dest != 0 && modes[dest - 1] == MOD_POSITION && written.count(ip + dest) == 0)
+                  writes.insert(memory[ip + dest]);
+               else if (dest != 0)
+                  anywhere = true;
+            }
+
+            // both only grow, so this ends
+            if ((unresolved || !anywhere) && std::includes(written.begin(), written.end(), writes.begin(), writes.end()))
+               break;
+
+            written.insert(writes.begin(), writes.end());
+            unresolved = unresolved || anywhere;
+         }
+
+         for (auto const& [ip, op] : code)
+         {
+            if (ends_block(op) && code.count(op.next) != 0)
+               leaders.insert(op.next);
+
+            if (is_jump(op) && target(ip, op) && branch(ip, op) != branch_t::never)
+               leaders.insert(*target(ip, op));
+         }
+      }
+
+      void reach_code()
+      {
+         std::vector<offset_t> work{ 0 };
+
+         while (!work.empty())
+         {
+            offset_t ip = work.back();
+            work.pop_back();
+
+            if (ip < 0 || code.count(ip) != 0 || !is_instruction(memory, ip))
+               continue;
+
+            decoded_t const op = decode_instruction(memory[ip], ip);
+            code[ip] = op;
+
+            if (op.opcode == OP_HALT)
+               continue;
+
+            if (!is_jump(op) || branch(ip, op) != branch_t::always)
+               work.push_back(op.next);
+
+            if (is_jump(op) && target(ip, op) && branch(ip, op) != branch_t::never)
+               work.push_back(*target(ip, op));
+
+            // a call comes back to the instruction after it
+            if (is_call(ip, op))
+               work.push_back(op.next);
+         }
+      }
+
+      void split()
+      {
+         for (offset_t const leader : leaders)
+         {
+            if (code.count(leader) == 0) continue;
+
+            basic_block_t block;
+            block.start = leader;
+
+            offset_t ip = leader;
+            while (true)
+            {
+               decoded_t const& op = code.at(ip);
+               block.instructions.push_back(ip);
+               block.end = op.next;
+
+               if (ends_block(op))
+               {
+                  terminate(block, ip, op);
+                  break;
+               }
+
+               if (code.count(op.next) == 0)
+                  break;
+
+               if (leaders.count(op.next) != 0)
+               {
+                  block.successors.push_back({ op.next, edge_kind_t::fallthrough });
+                  break;
+               }
+
+               ip = op.next;
+            }
+
+            cfg.blocks[leader] = std::move(block);
+         }
+      }
+
+      void terminate(basic_block_t& block, offset_t const ip, decoded_t const& op)
+      {
+         if (op.opcode == OP_HALT) return;
+
+         branch_t const taken = branch(ip, op);
+         bool const falls = taken != branch_t::always && code.count(op.next) != 0;
+
+         if (taken == branch_t::never)
+         {
+            if (falls) block.successors.push_back({ op.next, edge_kind_t::fallthrough });
+            return;
+         }
+
+         auto const destination = target(ip, op);
+         if (!destination)
+         {
+            auto const before = previous(ip);
+            bool const unwinds = before && code.at(*before).opcode == OP_BASEOFF;
+
+            if (op.mod2 == MOD_RELBASE && (unwinds || taken == branch_t::always))
+               block.returns = true;
+            else
+               block.computed = true;
+
+            if (falls) block.successors.push_back({ op.next, edge_kind_t::fallthrough });
+            return;
+         }
+
+         if (is_call(ip, op) && code.count(*destination) != 0)
+         {
+            cfg.functions.insert(*destination);
+            calls[*destination].push_back(block.start);
+            block.successors.push_back({ *destination, edge_kind_t::call });
+            if (code.count(op.next) != 0)
+               block.successors.push_back({ op.next, edge_kind_t::fallthrough });
+            return;
+         }
+
+         if (code.count(*destination) != 0)
+            block.successors.push_back({ *destination, taken == branch_t::always ? edge_kind_t::jump : edge_kind_t::taken });
+         if (falls)
+            block.successors.push_back({ op.next, edge_kind_t::fallthrough });
+      }
+
+      std::vector<offset_t> reach(offset_t const entry) const
+      {
+         std::vector<offset_t> reached;
+         std::set<offset_t> seen{ entry };
+         std::deque<offset_t> work{ entry };
+
+         while (!work.empty())
+         {
+            offset_t const start = work.front();
+            work.pop_front();
+            reached.push_back(start);
+
+            for (auto const& edge : cfg.blocks.at(start).successors)
+            {
+               if (is_local(edge) && seen.insert(edge.target).second)
+                  work.push_back(edge.target);
+            }
+         }
+
+         return reached;
+      }
+
+      void assign_functions()
+      {
+         cfg.functions.insert(0);
+
+         // routines are visited in address order, so the entry claims its
+         // blocks first; blocks no routine reaches keep their own address
+         std::set<offset_t> assigned;
+         for (offset_t const entry : cfg.functions)
+         {
+            if (cfg.blocks.count(entry) == 0) continue;
+
+            for (offset_t const start : reach(entry))
+            {
+               if (assigned.insert(start).second)
+                  cfg.blocks[start].function = entry;
+            }
+         }
+
+         for (auto& [start, block] : cfg.blocks)
+         {
+            if (assigned.count(start) == 0)
+               block.function = start;
+         }
+      }
+
+      // a returning block goes back to the call sites of every routine it is part of
+      void link_returns()
+      {
+         for (auto const& [entry, sites] : calls)
+         {
+            for (offset_t const start : reach(entry))
+            {
+               basic_block_t& block = cfg.blocks[start];
+               if (!block.returns) continue;
+
+               for (offset_t const site : sites)
+               {
+                  offset_t const back = cfg.blocks.at(site).end;
+                  if (cfg.blocks.count(back) != 0)
+                     block.successors.push_back({ back, edge_kind_t::ret });
+               }
+            }
+         }
+      }
+
+      // depth first search from each routine entry; an edge to a block on
+      // the stack is a back edge
+      void find_loops()
+      {
+         std::set<offset_t> done;
+
+         for (offset_t const entry : cfg.functions)
+         {
+            if (cfg.blocks.count(entry) == 0 || done.count(entry) != 0) continue;
+
+            std::set<offset_t> active{ entry };
+            std::vector<std::pair<offset_t, size_t>> stack{ {entry, 0} };
+
+            while (!stack.empty())
+            {
+               auto& [start, next] = stack.back();
+               auto& successors = cfg.blocks[start].successors;
+
+               if (next == successors.size())
+               {
+                  active.erase(start);
+                  done.insert(start);
+                  stack.pop_back();
+                  continue;
+               }
+
+               cfg_edge_t& edge = successors[next++];
+               if (!is_local(edge)) continue;
+
+               if (active.count(edge.target) != 0)
+               {
+                  edge.back = true;
+                  cfg.loops.insert(edge.target);
+               }
+               else if (done.count(edge.target) == 0)
+               {
+                  active.insert(edge.target);
+                  stack.push_back({ edge.target, 0 });
+               }
+            }
+         }
+      }
+   };
+
+   std::string node_name(offset_t const start)
+   {
+      return fmt::format("b{0:04x}", start);
+   }
+}
+
+cfg_t build_cfg(memory_t const& memory)
+{
+   return cfg_builder_t(memory).build();
+}
+
+std::set<offset_t> loop_body(cfg_t const& cfg, offset_t const header)
+{
+   // predecessors over the local edges
+   std::map<offset_t, std::vector<offset_t>> predecessors;
+   for (auto const& [start, block] : cfg.blocks)
+   {
+      for (auto const& edge : block.successors)
+      {
+         if (is_local(edge))
+            predecessors[edge.target].push_back(start);
+      }
+   }
+
+   std::set<offset_t> body{ header };
+   std::vector<offset_t> work;
+   for (auto const& [start, block] : cfg.blocks)
+   {
+      for (auto const& edge : block.successors)
+      {
+         if (edge.back && edge.target == header && body.insert(start).second)
+            work.push_back(start);
+      }
+   }
+
+   while (!work.empty())
+   {
+      offset_t const start = work.back();
+      work.pop_back();
+
+      for (offset_t const from : predecessors[start])
+      {
+         if (body.insert(from).second)
+            work.push_back(from);
+      }
+   }
+
+   return body;
+}
+
+void write_graphviz(std::ostream& out, cfg_t const& cfg, memory_t const& memory)
+{
+   out << "digraph cfg {\n";
+   out << "   node [shape=box fontname=\"Courier\" fontsize=10];\n";
+
+   std::map<offset_t, std::vector<offset_t>> routines;
+   for (auto const& [start, block] : cfg.blocks)
+      routines[block.function].push_back(start);
+
+   for (auto const& [entry, blocks] : routines)
+   {
+      bool const cluster = cfg.functions.count(entry) != 0;
+      if (cluster)
+         out << fmt::format("   subgraph cluster_{0} {{\n      label=\"routine {1:04x}\";\n", node_name(entry), entry);
+
+      for (offset_t const start : blocks)
+      {
+         basic_block_t const& block = cfg.blocks.at(start);
+
+         std::string label;
+         for (offset_t const ip : block.instructions)
+            label += fmt::format("{0:04x} {1}\\l", ip, format_instruction(memory, ip));
+
+         std::string style;
+         if (cfg.loops.count(start) != 0) style += " style=filled fillcolor=mistyrose";
+         if (block.returns) style += " peripheries=2";
+
+         out << fmt::format("{0}   {1} [label=\"{2}\"{3}];\n", cluster ? "   " : "", node_name(start), label, style);
+      }
+
+      if (cluster)
+         out << "   }\n";
+   }
+
+   bool computed = false;
+   for (auto const& [start, block] : cfg.blocks)
+   {
+      for (auto const& edge : block.successors)
+      {
+         std::string style;
+         switch (edge.kind)
+         {
+         case edge_kind_t::fallthrough: break;
+         case edge_kind_t::taken:       style = "label=\"T\" color=darkgreen"; break;
+         case edge_kind_t::jump:        style = "color=black"; break;
+         case edge_kind_t::call:        style = "color=blue style=bold"; break;
+         case edge_kind_t::ret:         style = "color=gray style=dashed"; break;
+         }
+         if (edge.back)
+            style += " color=red penwidth=2";
+
+         out << fmt::format("   {0} -> {1} [{2}];\n", node_name(start), node_name(edge.target), style);
+      }
+
+      if (block.computed)
+      {
+         out << fmt::format("   {0} -> computed [style=dotted];\n", node_name(start));
+         computed = true;
+      }
+   }
+
+   if (computed)
+      out << "   computed [shape=ellipse label=\"computed jump\"];\n";
+
+   out << "}\n";
+}
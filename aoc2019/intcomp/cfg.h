@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <set>
+#include <ostream>
+
+#include "intcode.h"
+
+enum class edge_kind_t
+{
+   fallthrough,   // into the next block in memory
+   taken,         // conditional jump taken
+   jump,          // unconditional jump
+   call,          // jump to a routine after storing the return address at [base+k]
+   ret,           // jump through [base+k] back to a call site
+};
+
+struct cfg_edge_t
+{
+   offset_t    target = 0;
+   edge_kind_t kind = edge_kind_t::fallthrough;
+   bool        back = false;   // closes a loop
+};
+
+struct basic_block_t
+{
+   offset_t                start = 0;
+   offset_t                end = 0;           // one past the last instruction
+   std::vector<offset_t>   instructions;
+   std::vector<cfg_edge_t> successors;
+   offset_t                function = 0;      // entry of the routine the block was first reached from
+   bool                    computed = false;  // ends with a jump whose target is not known statically
+   bool                    returns = false;
+};
+
+// control flow graph of the code reachable from address 0. jump targets and
+// conditions are resolved from the operands no instruction writes to, and
+// from the cells they point to if no instruction writes there either; once
+// the code writes through the relative base any cell may change, so nothing
+// is resolved and every jump is conditional and computed. a jump through
+// [base+k] right after a relative base adjustment is taken as a return, and
+// a constant jump right after the address that follows it is stored at
+// [base+k] as a call, which is how compiled Intcode pushes its return
+// addresses
+struct cfg_t
+{
+   std::map<offset_t, basic_block_t> blocks;
+   // routine entries: the program entry and every call target
+   std::set<offset_t>                functions;
+   // headers of the loops, the targets of back edges
+   std::set<offset_t>                loops;
+};
+
+cfg_t build_cfg(memory_t const& memory);
+
+// the blocks of a loop: the header and every block that reaches a back edge into it
+std::set<offset_t> loop_body(cfg_t const& cfg, offset_t const header);
+
+void write_graphviz(std::ostream& out, cfg_t const& cfg, memory_t const& memory);
@@ -0,0 +1,113 @@
+#include <map>
+
+#define FMT_HEADER_ONLY 1
+#include "fmt/core.h"
+#include "fmt/format.h"
+
+#include "disassembler.h"
+
+std::string format_parameter(memory_unit const value, int const mode)
+{
+   switch (mode)
+   {
+   case MOD_POSITION:
+      return fmt::format("[{0}]", value);
+   case MOD_IMMEDIATE:
+      return fmt::format("{0}", value);
+   case MOD_RELBASE:
+      return fmt::format(value > 0 ? "[base+{0}]":"[base{0}]", value);
+   default:
+      throw std::runtime_error("invalid parameter mode");
+   }
+}
+
+bool is_instruction(memory_t const& memory, size_t const ip)
+{
+   if (ip >= memory.size()) return false;
+
+   decoded_t const op = decode_instruction(memory[ip], ip);
+   if (op.opcode == 0 || op.next > memory.size()) return false;
+
+   // modes past the parameters of the instruction must be zero
+   memory_unit const modes = memory[ip] / 100;
+   int const parameters = instruction_length(op.opcode) - 1;
+   if (modes >= memory_unit{ 1000 }) return false;
+
+   int const mods[] = { op.mod1, op.mod2, op.mod3 };
+   for (int k = 0; k < 3; ++k)
+   {
+      if (k >= parameters && mods[k] != 0) return false;
+      if (mods[k] > MOD_RELBASE) return false;
+   }
+
+   // the output operand cannot be immediate
+   switch (op.opcode)
+   {
+   case OP_ADD:
+   case OP_MUL:
+   case OP_LS:
+   case OP_EQ:
+      return op.mod3 != MOD_IMMEDIATE;
+   case OP_IN:
+      return op.mod1 != MOD_IMMEDIATE;
+   default:
+      return true;
+   }
+}
+
+std::string format_instruction(memory_t const& memory, size_t const ip)
+{
+   static std::map<int, std::string> const opcodes{ {1, "add"}, {2,"mul"}, {3, "in"}, {4, "out"}, {5, "jnz"}, {6, "jz"}, {7, "le"}, {8, "eq"}, {9, "bso"}, {99, "hlt"} };
+
+   if (!is_instruction(memory, ip))
+      return fmt::format("{0:5}{1}", "data", ip < memory.size() ? memory[ip] : 0);
+
+   decoded_t const op = decode_instruction(memory[ip], ip);
+   std::string text = fmt::format("{0:5}", opcodes.at(op.opcode));
+
+   switch (op.opcode)
+   {
+   case OP_ADD:
+   case OP_MUL:
+   case OP_LS:
+   case OP_EQ:
+      text += fmt::format("{0}, {1}, {2}",
+         format_parameter(memory[ip + 1], op.mod1),
+         format_parameter(memory[ip + 2], op.mod2),
+         format_parameter(memory[ip + 3], op.mod3));
+      break;
+   case OP_IN:
+   case OP_OUT:
+      text += format_parameter(memory[ip + 1], op.mod1);
+      break;
+   case OP_JMPNZ:
+   case OP_JMPZ:
+      text += fmt::format("{0}, {1}",
+         format_parameter(memory[ip + 1], op.mod1),
+         format_parameter(memory[ip + 2], op.mod2));
+      break;
+   case OP_BASEOFF:
+      if (op.mod1 == MOD_IMMEDIATE)
+         text += fmt::format("base{0}{1}", memory[ip + 1] > 0 ? "+" : "", memory[ip + 1]);
+      else
+         text += format_parameter(memory[ip + 1], op.mod1);
+      break;
+   }
+
+   return text;
+}
+
+size_t instruction_size(memory_t const& memory, size_t const ip)
+{
+   return is_instruction(memory, ip) ? instruction_length(memory[ip] % 100) : 1;
+}
+
+void print_program(memory_t const& memory, std::string path)
+{
+   size_t ip = 0;
+   while (ip < memory.size())
+   {
+      fmt::print("{0:04x} {1}\n", ip, format_instruction(memory, ip));
+      ip += instruction_size(memory, ip);
+   }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+#include "intcode.h"
+
+std::string format_parameter(memory_unit const value, int const mode);
+
+// true if the cell at ip holds an instruction whose modes and operands are valid
+bool is_instruction(memory_t const& memory, size_t const ip);
+
+// the mnemonic and operands of the instruction at ip; a cell that is not an
+// instruction is formatted as data
+std::string format_instruction(memory_t const& memory, size_t const ip);
+
+// cells taken by format_instruction at ip
+size_t instruction_size(memory_t const& memory, size_t const ip);
+
+void print_program(memory_t const& memory, std::string path);
@@ -7,166 +7,401 @@
 #include <string>
 #include <string_view>
 #include <map>
+#include <set>
 
 #define FMT_HEADER_ONLY 1
 #include "fmt/core.h"
 #include "fmt/format.h"
 
-constexpr int OP_ADD = 1;
-constexpr int OP_MUL = 2;
-constexpr int OP_IN = 3;
-constexpr int OP_OUT = 4;
-constexpr int OP_JMPNZ = 5;
-constexpr int OP_JMPZ = 6;
-constexpr int OP_LS = 7;
-constexpr int OP_EQ = 8;
-constexpr int OP_BASEOFF = 9;
-constexpr int OP_HALT = 99;
-
-constexpr int MOD_POSITION = 0;
-constexpr int MOD_IMMEDIATE = 1;
-constexpr int MOD_RELBASE = 2;
-
-using memory_unit = long long;
-using memory_t = std::vector<memory_unit>;
-
-memory_t read_program(std::string_view text)
+#include "intcode.h"
+#include "intcode_asm.h"
+#include "intcode_replay.h"
+#include "disassembler.h"
+#include "cfg.h"
+#include "optimizer.h"
+
+std::string load_text(std::string const& path)
+{
+   std::ifstream input(path);
+   if (!input.is_open()) throw std::runtime_error("cannot open " + path);
+
+   std::string text;
+
+   input.seekg(0, std::ios::end);
+   text.reserve(input.tellg());
+   input.seekg(0, std::ios::beg);
+
+   text.assign(
+      std::istreambuf_iterator<char>(input),
+      std::istreambuf_iterator<char>());
+
+   return text;
+}
+
+// a program in text or, with the .icim extension, as a binary image
+memory_t load_program(std::string const& path)
 {
-   memory_t memory;
+   if (path.size() > 5 && path.substr(path.size() - 5) == ".icim")
+      return program_image_t(path).to_memory();
+
+   return read_program(load_text(path));
+}
 
-   std::string_view delimiter = ",";
-   size_t start = 0;
-   size_t end = text.find(delimiter);
+void print_loops(cfg_t const& cfg)
+{
+   fmt::print("{0} blocks, {1} routines, {2} loops\n", cfg.blocks.size(), cfg.functions.size(), cfg.loops.size());
 
-   std::string_view token;
-   while (end != std::string::npos)
+   for (offset_t const header : cfg.loops)
    {
-      token = text.substr(start, end - start);
+      auto const body = loop_body(cfg, header);
 
-      memory.push_back(std::atoll(token.data()));
+      size_t instructions = 0;
+      for (offset_t const start : body)
+         instructions += cfg.blocks.at(start).instructions.size();
 
-      start = end + 1;
-      end = text.find(delimiter, start);
+      fmt::print("loop {0:04x} in routine {1:04x}: {2} blocks, {3} instructions\n",
+         header, cfg.blocks.at(header).function, body.size(), instructions);
    }
+}
 
-   token = text.substr(start, end);
-
-   memory.push_back(std::atoll(token.data()));
+std::string format_modes(int const opcode, int const index)
+{
+   static char const* const names[] = { "pos", "imm", "rel" };
 
-   return memory;
+   std::string text;
+   int modes = index;
+   for (int k = 0; k < instruction_length(opcode) - 1; ++k, modes /= 3)
+      text += (k > 0 ? "," : "") + std::string(names[modes % 3]);
+   return text;
 }
 
-std::string format_parameter(memory_unit const value, int const mode)
+// opcode and mode counts, then the hottest instructions and blocks with their disassembly
+void print_profile(profile_t const& profile, memory_t const& memory, size_t const top)
 {
-   switch (mode)
+   static std::map<int, std::string> const mnemonics{ {1, "add"}, {2,"mul"}, {3, "in"}, {4, "out"}, {5, "jnz"}, {6, "jz"}, {7, "le"}, {8, "eq"}, {9, "bso"}, {99, "hlt"} };
+
+   double const total = static_cast<double>(std::max<uint64_t>(profile.total(), 1));
+   auto percent = [total](uint64_t const n) {return 100.0 * n / total; };
+
+   fmt::print("{0} instructions executed\n\nopcodes:\n", profile.total());
+
+   std::vector<std::pair<uint64_t, int>> opcodes;
+   for (auto const& [opcode, name] : mnemonics)
+      if (profile.opcodes[opcode] != 0) opcodes.push_back({ profile.opcodes[opcode], opcode });
+   std::sort(opcodes.rbegin(), opcodes.rend());
+
+   for (auto const& [count, opcode] : opcodes)
+      fmt::print("   {0:5}{1:>14} {2:6.2f}%\n", mnemonics.at(opcode), count, percent(count));
+
+   fmt::print("\nmodes:\n");
+
+   std::vector<std::pair<uint64_t, size_t>> modes;
+   for (size_t i = 0; i < profile.modes.size(); ++i)
+      if (profile.modes[i] != 0) modes.push_back({ profile.modes[i], i });
+   std::sort(modes.rbegin(), modes.rend());
+   if (modes.size() > top) modes.resize(top);
+
+   for (auto const& [count, index] : modes)
    {
-   case MOD_POSITION:
-      return fmt::format("[{0}]", value);
-   case MOD_IMMEDIATE:
-      return fmt::format("{0}", value);
-   case MOD_RELBASE:
-      return fmt::format(value > 0 ? "[base+{0}]":"[base{0}]", value);
-   default:
-      throw std::runtime_error("invalid parameter mode");
+      int const opcode = static_cast<int>(index / 27);
+      fmt::print("   {0:5}{1:12}{2:>14} {3:6.2f}%\n", mnemonics.at(opcode), format_modes(opcode, index % 27), count, percent(count));
+   }
+
+   fmt::print("\nhot spots:\n");
+
+   std::vector<std::pair<uint64_t, size_t>> addresses;
+   for (size_t ip = 0; ip < profile.addresses.size(); ++ip)
+      if (profile.addresses[ip] != 0) addresses.push_back({ profile.addresses[ip], ip });
+   std::sort(addresses.rbegin(), addresses.rend());
+   if (addresses.size() > top) addresses.resize(top);
+
+   for (auto const& [count, ip] : addresses)
+      fmt::print("{0:>14} {1:6.2f}%   {2:04x} {3}\n", count, percent(count), ip, format_instruction(memory, ip));
+
+   // instructions executed in each block of the graph
+   auto const cfg = build_cfg(memory);
+   auto executed = [&profile](offset_t const ip) {return static_cast<size_t>(ip) < profile.addresses.size() ? profile.addresses[ip] : 0; };
+
+   std::vector<std::pair<uint64_t, offset_t>> blocks;
+   for (auto const& [start, block] : cfg.blocks)
+   {
+      uint64_t count = 0;
+      for (offset_t const ip : block.instructions)
+         count += executed(ip);
+      if (count != 0) blocks.push_back({ count, start });
+   }
+   std::sort(blocks.rbegin(), blocks.rend());
+   if (blocks.size() > top) blocks.resize(top);
+
+   fmt::print("\nhot blocks:\n");
+   for (auto const& [count, start] : blocks)
+   {
+      basic_block_t const& block = cfg.blocks.at(start);
+      fmt::print("block {0:04x}{1}, routine {2:04x}: entered {3} times, {4:.2f}% of the instructions\n",
+         start, cfg.loops.count(start) != 0 ? " (loop header)" : "", block.function, executed(start), percent(count));
+
+      for (offset_t const ip : block.instructions)
+         fmt::print("{0:>14}   {1:04x} {2}\n", executed(ip), ip, format_instruction(memory, ip));
    }
 }
 
-void print_program(memory_t const& memory, std::string path)
+struct trace_run_t
 {
-   std::map<int, std::string> opcodes{ {1, "add"}, {2,"mul"}, {3, "in"}, {4, "out"}, {5, "jnz"}, {6, "jz"}, {7, "le"}, {8, "eq"}, {9, "bso"}, {99, "hlt"} };
+   memory_t outputs;
+   size_t   executed = 0;
+   bool     halted = false;
+};
 
-   size_t ip = 0;
-   while (ip < memory.size())
+// runs a program on the inputs of a recorded trace, until it halts or
+// needs more input than the trace has
+trace_run_t run_trace(memory_t const& memory, memory_t const& inputs)
+{
+   struct trace_input_t
    {
-      memory_unit inst = memory[ip];
-      int opcode = inst % 100;
-      inst /= 100;
-      int mod1 = inst % 10; inst /= 10;
-      int mod2 = inst % 10; inst /= 10;
-      int mod3 = inst % 10; inst /= 10;
-
-      fmt::print("{0:04x} {1:5}", ip, opcodes[opcode]);
-      switch (opcode) 
-      {
-      case 0:
-         ip++;
-         break;
-      case OP_ADD:
-         fmt::print("{0}, {1}, {2}", 
-            format_parameter(memory[ip+1], mod1), 
-            format_parameter(memory[ip+2], mod2),
-            format_parameter(memory[ip+3], mod3));
-         ip += 4;
-         break;
-      case OP_MUL:
-         fmt::print("{0}, {1}, {2}",
-            format_parameter(memory[ip + 1], mod1),
-            format_parameter(memory[ip + 2], mod2),
-            format_parameter(memory[ip + 3], mod3));
-         ip += 4;
-         break;
-      case OP_IN:
-         fmt::print(format_parameter(memory[ip + 1], mod1));
-         ip += 2;
-         break;
-      case OP_OUT:
-         fmt::print(format_parameter(memory[ip + 1], mod1));
-         ip += 2;
-         break;
-      case OP_JMPNZ:
-         fmt::print("{0}, {1}",
-            format_parameter(memory[ip + 1], mod1),
-            format_parameter(memory[ip + 2], mod2));
-         ip += 3;
-         break;
-      case OP_JMPZ:
-         fmt::print("{0}, {1}",
-            format_parameter(memory[ip + 1], mod1),
-            format_parameter(memory[ip + 2], mod2));
-         ip += 3;
-         break;
-      case OP_LS:
-         fmt::print("{0}, {1}, {2}",
-            format_parameter(memory[ip + 1], mod1),
-            format_parameter(memory[ip + 2], mod2),
-            format_parameter(memory[ip + 3], mod3));
-         ip += 4;
-         break;
-      case OP_EQ:
-         fmt::print("{0}, {1}, {2}",
-            format_parameter(memory[ip + 1], mod1),
-            format_parameter(memory[ip + 2], mod2),
-            format_parameter(memory[ip + 3], mod3));
-         ip += 4;
-         break;
-      case OP_BASEOFF:
-         fmt::print("base{0}{1}", memory[ip + 1] > 0 ? "+" : "", memory[ip + 1]);
-         ip += 2;
-         break;
-      case 99:
-         ip += 2;
-         break;
-      }
-      fmt::print("\n");
+      memory_t const& values;
+      size_t          next = 0;
+
+      bool ready() const { return next < values.size(); }
+      memory_unit operator()() { return values[next++]; }
+   };
+
+   trace_run_t run;
+   trace_input_t fin{ inputs };
+   auto fout = [&run](memory_unit const value) {run.outputs.push_back(value); return false; };
+
+   program_t program{ memory };
+   while (!program.step(fin, fout))
+   {
+      if (++run.executed > 1'000'000'000)
+         throw std::runtime_error("trace does not finish");
    }
+   run.halted = program.is_halted();
+
+   return run;
 }
 
-int main()
+std::set<offset_t> successors(cfg_t const& cfg, offset_t const start)
 {
-   std::ifstream input("..\\data\\aoc2019_11_input1.txt");
-   if (!input.is_open()) return -1;
+   std::set<offset_t> targets;
+   for (auto const& edge : cfg.blocks.at(start).successors)
+      targets.insert(edge.target);
+   return targets;
+}
 
-   std::string text;
+// programs whose graph is easy to get wrong
+void check_cfg()
+{
+   // the add clears the condition of the jump, which then falls through to out 42
+   auto const cleared = build_cfg(read_program("1101,0,0,5,1105,1,11,104,42,99,0,104,7,99"));
+   if (successors(cleared, 0) != std::set<offset_t>{ 7, 11 } || cleared.blocks.count(7) == 0)
+      throw std::runtime_error("cfg: a jump whose condition is written is taken as constant");
 
-   input.seekg(0, std::ios::end);
-   text.reserve(input.tellg());
-   input.seekg(0, std::ios::beg);
+   // a jump table: the add writes the target operand of the jump with the entry to take
+   auto const table = build_cfg(read_program("3,20,1001,20,12,8,105,1,0,99,0,0,14,17,104,1,99,104,2,99"));
+   if (!table.blocks.at(0).computed || !successors(table, 0).empty())
+      throw std::runtime_error("cfg: a jump whose target is written is taken as constant");
 
-   text.assign(
-      std::istreambuf_iterator<char>(input),
-      std::istreambuf_iterator<char>());
+   // once anything is written through the relative base, no operand is constant
+   auto const stack = build_cfg(read_program("109,20,21101,0,7,0,1105,1,11,104,1,99,104,2,99"));
+   if (!stack.blocks.at(0).computed || successors(stack, 0) != std::set<offset_t>{ 9 })
+      throw std::runtime_error("cfg: a jump is taken as constant after a relative base write");
+
+   fmt::print("cfg checks passed\n");
+}
+
+memory_t run_outputs(memory_t const& memory, memory_t const& inputs)
+{
+   return run_trace(memory, inputs).outputs;
+}
+
+// the optimized programs must behave as the originals
+void check_optimizer()
+{
+   optimizer_stats_t stats;
+
+   auto const cleared = read_program("1101,0,0,5,1105,1,11,104,42,99,0,104,7,99");
+   if (run_outputs(optimize_program(cleared, stats), {}) != memory_t{ 42 })
+      throw std::runtime_error("opt: a jump whose condition is written is folded");
+
+   // a jump table gives nothing to rely on
+   auto const table = read_program("3,20,1001,20,12,8,105,1,0,99,0,0,14,17,104,1,99,104,2,99");
+   if (optimize_program(table, stats) != table || stats.computed_jumps != 1)
+      throw std::runtime_error("opt: a program with a computed jump is rewritten");
+
+   // the product folds into the jump, which is then always taken and leaves 104,0,99 unreachable
+   auto const folded = read_program("1101,2,3,20,1002,20,4,21,1005,21,15,104,0,99,0,4,21,99");
+   auto const optimized = optimize_program(folded, stats);
+   if (run_outputs(optimized, {}) != memory_t{ 20 } || stats.folded == 0 || stats.unreachable == 0)
+      throw std::runtime_error("opt: constants are not folded or dead code is kept");
+
+   fmt::print("optimizer checks passed\n");
+}
+
+void write_program(memory_t const& memory, std::string const& path)
+{
+   std::ofstream output(path);
+   if (!output.is_open()) throw std::runtime_error("cannot create " + path);
+
+   for (size_t i = 0; i < memory.size(); ++i)
+      output << (i > 0 ? "," : "") << memory[i];
+   output << "\n";
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 3 && !(argc == 2 && std::string_view(argv[1]) == "check"))
+   {
+      fmt::print("usage: intcomp disasm <program>\n");
+      fmt::print("       intcomp cfg <program> <output.dot>\n");
+      fmt::print("       intcomp asm <source> <program>\n");
+      fmt::print("       intcomp opt <program> <output> [<trace>...]\n");
+      fmt::print("       intcomp profile <program> [<trace>]\n");
+      fmt::print("       intcomp record <program> <trace> <log>\n");
+      fmt::print("       intcomp replay <program> <log> [<instruction>]\n");
+      fmt::print("       intcomp image <program> <output.icim>\n");
+      fmt::print("       intcomp check\n");
+      return -1;
+   }
+
+   try
+   {
+      std::string const command = argv[1];
+
+      if (command == "check")
+      {
+         check_cfg();
+         check_optimizer();
+         return 0;
+      }
+
+      if (command == "asm" && argc >= 4)
+      {
+         auto const memory = assemble(load_text(argv[2]));
+         write_program(memory, argv[3]);
+
+         fmt::print("{0} cells\n", memory.size());
+         return 0;
+      }
+
+      if (command == "image" && argc >= 4)
+      {
+         std::string const text = load_text(argv[2]);
+         auto const memory = read_program(text);
+         write_image(argv[3], memory, hash_source(text));
+
+         fmt::print("{0} cells, source hash {1:016x}\n", memory.size(), hash_source(text));
+         return 0;
+      }
+
+      auto memory = load_program(argv[2]);
+
+      if (command == "disasm")
+      {
+         print_program(memory, "program.asm");
+      }
+      else if (command == "cfg" && argc >= 4)
+      {
+         auto const cfg = build_cfg(memory);
 
-   auto memory = read_program("3,12,6,12,15,1,13,14,13,4,13,99,-1,0,1,9");
+         std::ofstream output(argv[3]);
+         if (!output.is_open()) throw std::runtime_error(std::string("cannot create ") + argv[3]);
+         write_graphviz(output, cfg, memory);
 
-   print_program(memory, "program.asm");
+         print_loops(cfg);
+      }
+      else if (command == "opt" && argc >= 4)
+      {
+         optimizer_stats_t stats;
+         auto const optimized = optimize_program(memory, stats);
+
+         if (stats.computed_jumps != 0)
+            fmt::print("{0} jumps with unknown targets, program left as it is\n", stats.computed_jumps);
+
+         fmt::print("{0} blocks rewritten: {1} folded, {2} operands propagated, {3} removed, {4} base adjustments merged, {5} unreachable\n",
+            stats.blocks, stats.folded, stats.propagated, stats.removed, stats.merged_bases, stats.unreachable);
+         fmt::print("{0} -> {1} instructions, {2} -> {3} cells\n",
+            stats.instructions_before, stats.instructions_after, memory.size(), optimized.size());
+
+         // both versions must produce the same outputs on every recorded trace
+         for (int i = 4; i < argc; ++i)
+         {
+            auto const inputs = read_program(load_text(argv[i]));
+            auto const expected = run_trace(memory, inputs);
+            auto const actual = run_trace(optimized, inputs);
+
+            if (actual.outputs != expected.outputs || actual.halted != expected.halted)
+               throw std::runtime_error(std::string("optimized program differs on ") + argv[i]);
+
+            fmt::print("{0}: {1} outputs, {2} -> {3} instructions executed\n", argv[i], expected.outputs.size(), expected.executed, actual.executed);
+         }
+
+         write_program(optimized, argv[3]);
+      }
+      else if (command == "profile")
+      {
+         memory_t const inputs = argc >= 4 ? read_program(load_text(argv[3])) : memory_t{};
+
+         profile_t profile;
+         program_t program{ memory };
+         program.set_profile(&profile);
+
+         memory_t outputs;
+         program.run(inputs, outputs);
+
+         print_profile(profile, memory, 20);
+      }
+      else if (command == "record" && argc >= 5)
+      {
+         memory_t const inputs = read_program(load_text(argv[3]));
+
+         std::ofstream log(argv[4], std::ios::binary);
+         if (!log.is_open()) throw std::runtime_error(std::string("cannot create ") + argv[4]);
+
+         trace_writer_t writer{ log };
+         program_t program{ memory };
+         program.set_trace(&writer);
+
+         memory_t outputs;
+         program.run(inputs, outputs);
+         writer.flush();
+
+         fmt::print("{0} inputs recorded over {1} instructions, {2} outputs{3}\n",
+            writer.size(), program.instructions(), outputs.size(), program.is_halted() ? ", halted" : "");
+      }
+      else if (command == "replay" && argc >= 4)
+      {
+         std::ifstream log(argv[3], std::ios::binary);
+         if (!log.is_open()) throw std::runtime_error(std::string("cannot open ") + argv[3]);
+
+         trace_replay_t replay{ memory, read_trace(log) };
+
+         memory_t outputs;
+         auto fout = [&outputs](memory_unit const value) {outputs.push_back(value); };
+         if (argc >= 5)
+            replay.run_to(std::stoull(argv[4]), fout);
+         else
+            replay.run(fout);
+
+         program_t& machine = replay.machine();
+         fmt::print("{0} instructions, {1} of {2} inputs consumed, {3} outputs{4}\n",
+            replay.position(), replay.inputs_consumed(), replay.inputs(), outputs.size(), machine.is_halted() ? ", halted" : "");
+
+         // the instruction the machine stopped at
+         offset_t const ip = machine.get_ip();
+         memory_t cells;
+         for (offset_t off = 0; off < ip + 4; ++off)
+            cells.push_back(machine.read(off));
+         fmt::print("ip {0:04x}, base {1}: {2}\n", ip, machine.get_rel_base(), format_instruction(cells, ip));
+      }
+      else
+      {
+         fmt::print("unknown command {0}\n", command);
+         return -1;
+      }
+   }
+   catch (std::exception const& ex)
+   {
+      fmt::print("{0}\n", ex.what());
+      return -1;
+   }
 }
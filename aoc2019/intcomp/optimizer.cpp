@@ -0,0 +1,508 @@
+#include <map>
+#include <set>
+#include <optional>
+
+#include "optimizer.h"
+#include "cfg.h"
+
+namespace
+{
+   struct operand_t
+   {
+      int         mode = MOD_IMMEDIATE;
+      memory_unit value = 0;
+
+      bool operator==(operand_t const&) const = default;
+   };
+
+   struct instruction_t
+   {
+      int       opcode = 0;
+      operand_t operands[3];
+      // some of its cells are addressed as data, so it is kept as it is
+      bool      pinned = false;
+
+      bool operator==(instruction_t const&) const = default;
+   };
+
+   // a cell named by an operand; relative base cells by their offset from
+   // the base at the start of the block
+   struct location_t
+   {
+      int         mode = MOD_POSITION;
+      memory_unit address = 0;
+
+      auto operator<=>(location_t const&) const = default;
+   };
+
+   // what a cell is known to hold: a constant, as an immediate operand, or
+   // the value of another cell, as the location of that cell
+   using known_t = std::map<location_t, operand_t>;
+
+   int parameter_count(int const opcode)
+   {
+      return instruction_length(opcode) - 1;
+   }
+
+   // index of the operand an instruction writes to, or -1
+   int written_operand(int const opcode)
+   {
+      switch (opcode)
+      {
+      case OP_ADD:
+      case OP_MUL:
+      case OP_LS:
+      case OP_EQ:    return 2;
+      case OP_IN:    return 0;
+      default:       return -1;
+      }
+   }
+
+   bool is_jump(int const opcode)
+   {
+      return opcode == OP_JMPNZ || opcode == OP_JMPZ;
+   }
+
+   // a position cell may be the same as any relative base cell
+   bool may_alias(location_t const& a, location_t const& b)
+   {
+      return a.mode != b.mode || a.address == b.address;
+   }
+
+   location_t locate(operand_t const& op, memory_unit const delta)
+   {
+      return { op.mode, op.mode == MOD_RELBASE ? op.value + delta : op.value };
+   }
+
+   operand_t operand_at(location_t const& loc, memory_unit const delta)
+   {
+      return { loc.mode, loc.mode == MOD_RELBASE ? loc.address - delta : loc.address };
+   }
+
+   memory_unit evaluate(int const opcode, memory_unit const a, memory_unit const b)
+   {
+      switch (opcode)
+      {
+      case OP_ADD:   return a + b;
+      case OP_MUL:   return a * b;
+      case OP_LS:    return a < b ? 1 : 0;
+      case OP_EQ:    return a == b ? 1 : 0;
+      default:       throw std::runtime_error("not an arithmetic instruction");
+      }
+   }
+
+   // true if control never goes past the instruction
+   bool ends_flow(instruction_t const& ins)
+   {
+      if (ins.opcode == OP_HALT) return true;
+      if (!is_jump(ins.opcode) || ins.operands[0].mode != MOD_IMMEDIATE) return false;
+
+      return (ins.operands[0].value != 0) == (ins.opcode == OP_JMPNZ);
+   }
+
+   void invalidate(known_t& known, location_t const& dest)
+   {
+      std::erase_if(known, [&dest](auto const& entry) {
+         auto const& [loc, value] = entry;
+         return may_alias(loc, dest) || (value.mode != MOD_IMMEDIATE && may_alias({ value.mode, value.value }, dest)); });
+   }
+
+   std::vector<instruction_t> decode_block(memory_t const& memory, basic_block_t const& block, std::set<offset_t> const& data_cells)
+   {
+      std::vector<instruction_t> code;
+
+      for (offset_t const ip : block.instructions)
+      {
+         decoded_t const op = decode_instruction(memory[ip], ip);
+         int const modes[] = { op.mod1, op.mod2, op.mod3 };
+
+         instruction_t ins;
+         ins.opcode = op.opcode;
+         for (int k = 0; k < parameter_count(op.opcode); ++k)
+            ins.operands[k] = { modes[k], memory[ip + k + 1] };
+
+         for (offset_t at = ip; at < static_cast<offset_t>(op.next); ++at)
+            ins.pinned = ins.pinned || data_cells.count(at) != 0;
+
+         code.push_back(ins);
+      }
+
+      return code;
+   }
+
+   std::vector<memory_unit> encode_block(std::vector<instruction_t> const& code)
+   {
+      std::vector<memory_unit> cells;
+
+      for (auto const& ins : code)
+      {
+         memory_unit inst = ins.opcode;
+         memory_unit scale = 100;
+         for (int k = 0; k < parameter_count(ins.opcode); ++k, scale *= 10)
+            inst += ins.operands[k].mode * scale;
+
+         cells.push_back(inst);
+         for (int k = 0; k < parameter_count(ins.opcode); ++k)
+            cells.push_back(ins.operands[k].value);
+      }
+
+      return cells;
+   }
+
+   // replaces the operands that read a cell of known value, folds the
+   // instructions whose operands are all constants
+   void propagate(std::vector<instruction_t>& code, optimizer_stats_t& stats)
+   {
+      known_t known;
+      memory_unit delta = 0;
+      bool base_known = true;
+
+      for (auto& ins : code)
+      {
+         if (ins.pinned || !base_known)
+         {
+            known.clear();
+            base_known = base_known && ins.opcode != OP_BASEOFF;
+            continue;
+         }
+
+         int const written = written_operand(ins.opcode);
+         bool substituted = false;
+
+         for (int k = 0; k < parameter_count(ins.opcode); ++k)
+         {
+            operand_t& op = ins.operands[k];
+            if (k == written || op.mode == MOD_IMMEDIATE) continue;
+
+            auto it = known.find(locate(op, delta));
+            if (it == known.end()) continue;
+
+            op = it->second.mode == MOD_IMMEDIATE ? it->second : operand_at({ it->second.mode, it->second.value }, delta);
+            substituted = true;
+            stats.propagated++;
+         }
+
+         switch (ins.opcode)
+         {
+         case OP_ADD:
+         case OP_MUL:
+         case OP_LS:
+         case OP_EQ:
+         {
+            operand_t& a = ins.operands[0];
+            operand_t& b = ins.operands[1];
+            location_t const dest = locate(ins.operands[2], delta);
+
+            std::optional<operand_t> value;
+            if (a.mode == MOD_IMMEDIATE && b.mode == MOD_IMMEDIATE)
+            {
+               value = operand_t{ MOD_IMMEDIATE, evaluate(ins.opcode, a.value, b.value) };
+               if (ins.opcode != OP_ADD || substituted)
+               {
+                  ins.opcode = OP_ADD;
+                  a = *value;
+                  b = { MOD_IMMEDIATE, 0 };
+                  stats.folded++;
+               }
+            }
+            else if (ins.opcode == OP_MUL && ((a.mode == MOD_IMMEDIATE && a.value == 0) || (b.mode == MOD_IMMEDIATE && b.value == 0)))
+            {
+               value = operand_t{ MOD_IMMEDIATE, 0 };
+               ins.opcode = OP_ADD;
+               a = *value;
+               b = { MOD_IMMEDIATE, 0 };
+               stats.folded++;
+            }
+            else if ((ins.opcode == OP_ADD && b == operand_t{ MOD_IMMEDIATE, 0 }) || (ins.opcode == OP_MUL && b == operand_t{ MOD_IMMEDIATE, 1 }))
+            {
+               location_t const source = locate(a, delta);
+               value = operand_t{ source.mode, source.address };
+            }
+            else if ((ins.opcode == OP_ADD && a == operand_t{ MOD_IMMEDIATE, 0 }) || (ins.opcode == OP_MUL && a == operand_t{ MOD_IMMEDIATE, 1 }))
+            {
+               location_t const source = locate(b, delta);
+               value = operand_t{ source.mode, source.address };
+            }
+
+            invalidate(known, dest);
+            if (value && (value->mode == MOD_IMMEDIATE || location_t{ value->mode, value->value } != dest))
+               known[dest] = *value;
+            break;
+         }
+         case OP_IN:
+            invalidate(known, locate(ins.operands[0], delta));
+            break;
+         case OP_BASEOFF:
+            if (ins.operands[0].mode == MOD_IMMEDIATE)
+            {
+               delta += ins.operands[0].value;
+            }
+            else
+            {
+               base_known = false;
+               known.clear();
+            }
+            break;
+         }
+      }
+   }
+
+   // a jump at the end of the block that can never be taken goes away
+   void fold_jump(std::vector<instruction_t>& code, optimizer_stats_t& stats)
+   {
+      if (code.empty() || code.back().pinned) return;
+
+      instruction_t const& jump = code.back();
+      if (!is_jump(jump.opcode) || jump.operands[0].mode != MOD_IMMEDIATE) return;
+
+      if ((jump.operands[0].value != 0) != (jump.opcode == OP_JMPNZ))
+      {
+         code.pop_back();
+         stats.removed++;
+      }
+   }
+
+   // drops the stores overwritten later in the block before anything can read them
+   void remove_dead_stores(std::vector<instruction_t>& code, optimizer_stats_t& stats)
+   {
+      // offset of the base from its value at the start of the block, before each instruction
+      std::vector<std::optional<memory_unit>> deltas;
+      std::optional<memory_unit> delta = 0;
+      for (auto const& ins : code)
+      {
+         deltas.push_back(delta);
+         if (ins.opcode == OP_BASEOFF)
+            delta = delta && !ins.pinned && ins.operands[0].mode == MOD_IMMEDIATE ? std::optional(*delta + ins.operands[0].value) : std::nullopt;
+      }
+
+      std::set<location_t> overwritten;
+      std::vector<bool> dead(code.size(), false);
+
+      for (size_t i = code.size(); i-- > 0;)
+      {
+         instruction_t const& ins = code[i];
+         if (ins.pinned || !deltas[i])
+         {
+            overwritten.clear();
+            continue;
+         }
+
+         int const written = written_operand(ins.opcode);
+         if (written >= 0)
+         {
+            location_t const dest = locate(ins.operands[written], *deltas[i]);
+            if (ins.opcode != OP_IN && overwritten.count(dest) != 0)
+            {
+               dead[i] = true;
+               stats.removed++;
+               continue;
+            }
+            overwritten.insert(dest);
+         }
+
+         for (int k = 0; k < parameter_count(ins.opcode); ++k)
+         {
+            operand_t const& op = ins.operands[k];
+            if (k == written || op.mode == MOD_IMMEDIATE) continue;
+
+            location_t const read = locate(op, *deltas[i]);
+            std::erase_if(overwritten, [&read](location_t const& loc) {return may_alias(loc, read); });
+         }
+      }
+
+      std::vector<instruction_t> live;
+      for (size_t i = 0; i < code.size(); ++i)
+      {
+         if (!dead[i])
+            live.push_back(code[i]);
+      }
+      code = std::move(live);
+   }
+
+   // sinks immediate relative base adjustments to the end of the block (or
+   // to the next instruction that has to see the real base), adjusting the
+   // relative operands they move past
+   void merge_bases(std::vector<instruction_t>& code, optimizer_stats_t& stats)
+   {
+      std::vector<instruction_t> merged;
+      memory_unit pending = 0;
+      size_t adjustments = 0;
+      size_t emitted = 0;
+
+      auto flush = [&]() {
+         if (pending != 0)
+         {
+            instruction_t adjust;
+            adjust.opcode = OP_BASEOFF;
+            adjust.operands[0] = { MOD_IMMEDIATE, pending };
+            merged.push_back(adjust);
+            emitted++;
+         }
+         pending = 0; };
+
+      for (auto ins : code)
+      {
+         if (ins.opcode == OP_BASEOFF && !ins.pinned && ins.operands[0].mode == MOD_IMMEDIATE)
+         {
+            pending += ins.operands[0].value;
+            adjustments++;
+            continue;
+         }
+
+         if (ins.pinned || ins.opcode == OP_BASEOFF || is_jump(ins.opcode) || ins.opcode == OP_HALT)
+         {
+            flush();
+            merged.push_back(ins);
+            continue;
+         }
+
+         for (int k = 0; k < parameter_count(ins.opcode); ++k)
+         {
+            if (ins.operands[k].mode == MOD_RELBASE)
+               ins.operands[k].value += pending;
+         }
+         merged.push_back(ins);
+      }
+      flush();
+
+      stats.merged_bases += adjustments - emitted;
+      code = std::move(merged);
+   }
+
+   void add_stats(optimizer_stats_t& stats, optimizer_stats_t const& block)
+   {
+      stats.folded += block.folded;
+      stats.propagated += block.propagated;
+      stats.removed += block.removed;
+      stats.merged_bases += block.merged_bases;
+      stats.blocks++;
+   }
+
+   size_t count_instructions(cfg_t const& cfg)
+   {
+      size_t count = 0;
+      for (auto const& [start, block] : cfg.blocks)
+         count += block.instructions.size();
+      return count;
+   }
+}
+
+memory_t optimize_program(memory_t const& memory, optimizer_stats_t& stats)
+{
+   stats = {};
+
+   cfg_t const cfg = build_cfg(memory);
+   stats.instructions_before = count_instructions(cfg);
+   stats.instructions_after = stats.instructions_before;
+
+   for (auto const& [start, block] : cfg.blocks)
+      stats.computed_jumps += block.computed;
+
+   // a jump the graph cannot resolve may land inside any block
+   if (stats.computed_jumps != 0)
+      return memory;
+
+   // cells some instruction addresses as data, and instructions whose
+   // address a constant store puts in memory (return addresses, mostly),
+   // which a return may jump to
+   std::set<offset_t> data_cells;
+   std::set<offset_t> entries;
+   std::set<offset_t> instructions;
+
+   for (auto const& [start, block] : cfg.blocks)
+      instructions.insert(block.instructions.begin(), block.instructions.end());
+
+   for (offset_t const ip : instructions)
+   {
+      decoded_t const op = decode_instruction(memory[ip], ip);
+      int const modes[] = { op.mod1, op.mod2, op.mod3 };
+      for (int k = 0; k < parameter_count(op.opcode); ++k)
+      {
+         if (modes[k] == MOD_POSITION)
+            data_cells.insert(memory[ip + k + 1]);
+      }
+
+      if ((op.opcode == OP_ADD || op.opcode == OP_MUL) && op.mod1 == MOD_IMMEDIATE && op.mod2 == MOD_IMMEDIATE)
+      {
+         memory_unit const value = evaluate(op.opcode, memory[ip + 1], memory[ip + 2]);
+         if (instructions.count(value) != 0)
+            entries.insert(value);
+      }
+   }
+
+   memory_t result = memory;
+   std::set<offset_t> rewritten;
+
+   for (auto const& [start, block] : cfg.blocks)
+   {
+      auto const original = decode_block(memory, block, data_cells);
+      auto code = original;
+
+      optimizer_stats_t changes;
+      propagate(code, changes);
+      fold_jump(code, changes);
+      remove_dead_stores(code, changes);
+      merge_bases(code, changes);
+
+      if (code == original) continue;
+
+      auto cells = encode_block(code);
+      size_t const size = static_cast<size_t>(block.end - block.start);
+      if (cells.size() > size) continue;
+
+      // a shortened block that falls through jumps over the cells it freed
+      size_t executed = code.size();
+      size_t const gap = size - cells.size();
+      if (gap != 0 && (code.empty() || !ends_flow(code.back())))
+      {
+         if (gap >= 3)
+            cells.insert(cells.end(), { OP_JMPZ + 100 * MOD_IMMEDIATE + 1000 * MOD_IMMEDIATE, 0, block.end });
+         else if (gap == 2)
+            cells.insert(cells.end(), { OP_BASEOFF + 100 * MOD_IMMEDIATE, 0 });
+         else
+            continue;
+         executed++;
+      }
+      if (executed > original.size()) continue;
+
+      cells.resize(size, 0);
+
+      // the cells that moved or changed must not be read as data or entered
+      // from anywhere but the start of the block
+      auto const first = std::mismatch(cells.begin(), cells.end(), memory.begin() + block.start).first - cells.begin();
+      bool safe = true;
+      for (offset_t at = block.start + first; at < block.end; ++at)
+         safe = safe && data_cells.count(at) == 0 && (at == block.start || entries.count(at) == 0);
+      if (!safe) continue;
+
+      std::copy(cells.begin(), cells.end(), result.begin() + block.start);
+      rewritten.insert(block.start);
+      add_stats(stats, changes);
+   }
+
+   // blocks that jumps folded above no longer reach are cleared
+   cfg_t const after = build_cfg(result);
+   std::set<offset_t> reached;
+   for (auto const& [start, block] : after.blocks)
+      reached.insert(block.instructions.begin(), block.instructions.end());
+
+   for (auto const& [start, block] : cfg.blocks)
+   {
+      if (reached.lower_bound(block.start) != reached.lower_bound(block.end)) continue;
+
+      bool clear = true;
+      for (offset_t at = block.start; at < block.end; ++at)
+         clear = clear && data_cells.count(at) == 0 && entries.count(at) == 0;
+      if (!clear) continue;
+
+      std::fill(result.begin() + block.start, result.begin() + block.end, 0);
+      stats.unreachable += block.instructions.size();
+   }
+
+   // memory past the image reads as zero
+   while (!result.empty() && result.back() == 0)
+      result.pop_back();
+
+   stats.instructions_after = count_instructions(after);
+   return result;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "intcode.h"
+
+struct optimizer_stats_t
+{
+   size_t folded = 0;               // instructions whose result became a constant
+   size_t propagated = 0;           // operands replaced by a constant or the cell they copy
+   size_t removed = 0;              // dead stores and jumps that are never taken
+   size_t merged_bases = 0;         // relative base adjustments merged into a later one
+   size_t unreachable = 0;          // instructions no longer reached, cleared
+   size_t blocks = 0;               // blocks rewritten
+   size_t instructions_before = 0;  // instructions reachable from address 0
+   size_t instructions_after = 0;
+   size_t computed_jumps = 0;       // jumps with unknown targets
+};
+
+// Rewrites the basic blocks of a program into equivalent blocks with fewer
+// or cheaper instructions: operands known to hold a constant or a copy of
+// another cell are replaced by it, instructions on constants are folded,
+// stores overwritten in the same block are dropped and relative base
+// adjustments are merged. Intcode addresses are absolute and immediates
+// cannot be told from addresses, so nothing is moved across blocks: every
+// block keeps its address, a shortened one jumps over its tail, and the
+// code that becomes unreachable is cleared.
+//
+// Cells some instruction addresses as data are never changed, and neither
+// are the addresses stored by constant stores, which returns may jump to.
+// Jumps are taken as never or always taken only on operands the graph
+// found constant (see cfg_t), and a program with a jump the graph cannot
+// resolve is left as it is, since that jump may land inside any block. As
+// the graph resolves nothing once the code writes through the relative
+// base, this leaves out compiled Intcode that keeps a stack, most of the
+// puzzle inputs from day 09 on: the pass only changes programs without
+// relative base stores or jump tables.
+memory_t optimize_program(memory_t const& memory, optimizer_stats_t& stats);